@@ -17,24 +17,84 @@
 */
 #include "config.h"
 
+#if defined(PPM_INPUT_CAPTURE)
+//PA1 as PPM input, TIM2_CH2 rising edges latched at 48MHz and moved by DMA1 ch3
+#define PPM_TICKS       48          // per us
+#define PPM_EDGES       16          // capture ring, ~2 frames
+static volatile uint32_t ppmEdges[PPM_EDGES];
+#else
+//PA14(SWCLK) as PPM input, no timer on that pin, edges timed from TIM3
+#define PPM_TICKS       1
+#endif
+
+#define PPM_SYNC        (5000 * PPM_TICKS)
+#define PPM_MIN         (500 * PPM_TICKS)
+#define PPM_MAX         (2500 * PPM_TICKS)
 
-//PA14(SWCLK) as PPM input
 extern int16_t RXcommands[6];// Throttle,Roll,Pitch,Yaw,Aux1,Aux2
-extern uint8_t failsave;
 static uint8_t chanOrder[6] = {RC_CHAN_ORDER};
-static uint16_t RawChannels[6] = {1500, 1500, 1500, 1500, 1500, 1500};
-static uint8_t chanNewValue[6] = {1, 1, 1, 1, 1, 1};
+static uint32_t ppmWork[6];     // frame being received
+static uint32_t RawChannels[6] = {1500 * PPM_TICKS, 1500 * PPM_TICKS, 1500 * PPM_TICKS,
+                                  1500 * PPM_TICKS, 1500 * PPM_TICKS, 1500 * PPM_TICKS
+                                 };
+static seqlock_t RawChannelsSeq = 0;    // RawChannels is published whole
+static uint16_t channelBuffer[6] = {1500, 1500, 1500, 1500, 1500, 1500};  // us last written to RXcommands
+uint16_t ppmBadFrames = 0;
 
 void init_PPMRX()
 {
     GPIO_InitTypeDef RXGPIOinit;
+#if defined(PPM_INPUT_CAPTURE)
+    RXGPIOinit.GPIO_Pin = GPIO_Pin_1;
+    RXGPIOinit.GPIO_Mode = GPIO_Mode_AF;
+#else
     RXGPIOinit.GPIO_Pin = GPIO_Pin_14;
     RXGPIOinit.GPIO_Mode = GPIO_Mode_IN;
+#endif
     RXGPIOinit.GPIO_Speed = GPIO_Speed_50MHz;
     RXGPIOinit.GPIO_OType = GPIO_OType_OD;
     RXGPIOinit.GPIO_PuPd   = GPIO_PuPd_DOWN;
     GPIO_Init(GPIOA, &RXGPIOinit);
 
+#if defined(PPM_INPUT_CAPTURE)
+    GPIO_PinAFConfig(GPIOA, GPIO_PinSource1, GPIO_AF_2);
+
+    // 32 bit TIM2 free running at 48MHz, no wrap inside a frame
+    TIM_TimeBaseInitTypeDef timerbaseinit;
+    TIM_TimeBaseStructInit(&timerbaseinit);
+    timerbaseinit.TIM_Prescaler = 0;
+    timerbaseinit.TIM_Period = 0xFFFFFFFF;
+    TIM_DeInit(TIM2);
+    TIM_TimeBaseInit(TIM2, &timerbaseinit);
+
+    // Filter of 8 samples at 48MHz, shorter spikes never capture
+    TIM_ICInitTypeDef icinit;
+    TIM_ICStructInit(&icinit);
+    icinit.TIM_Channel = TIM_Channel_2;
+    icinit.TIM_ICPolarity = TIM_ICPolarity_Rising;
+    icinit.TIM_ICSelection = TIM_ICSelection_DirectTI;
+    icinit.TIM_ICFilter = 0x3;
+    TIM_ICInit(TIM2, &icinit);
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_InitTypeDef DMA_InitStructure;
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &TIM2->CCR2;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) ppmEdges;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = PPM_EDGES;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+    DMA_Init(DMA1_Channel3, &DMA_InitStructure);
+    DMA_Cmd(DMA1_Channel3, ENABLE);
+
+    TIM_DMACmd(TIM2, TIM_DMA_CC2, ENABLE);
+    TIM_Cmd(TIM2, ENABLE);
+#else
     SYSCFG_EXTILineConfig(EXTI_PortSourceGPIOA, EXTI_PinSource14);
 
     EXTI_InitTypeDef EXTI_InitStruct;
@@ -49,60 +109,185 @@ void init_PPMRX()
     NVIC_InitStructure.NVIC_IRQChannelPriority = 1;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
+#endif
+}
+
+
+// Hand the loop a complete frame. Frames with a pulse out of range, fewer
+// than PPM_MIN_CHANNELS or a channel count different from the last frame
+// are dropped whole.
+static void ppmPublish(uint8_t count, bool bad)
+{
+    static uint8_t lastCount = 0;
+    uint8_t i;
+
+    if (bad || count < PPM_MIN_CHANNELS || (lastCount && count != lastCount)) {
+        lastCount = count >= PPM_MIN_CHANNELS ? count : lastCount;
+        ppmBadFrames++;
+        return;
+    }
+
+    lastCount = count;
+
+    seqWriteBegin(&RawChannelsSeq);
+
+    for (i = 0; i < count; i++) {
+        RawChannels[i] = ppmWork[i];
+    }
+
+    seqWriteEnd(&RawChannelsSeq);
+
+    RXlastUpdate = micros();
 }
 
 
+// Time between two rising edges, in PPM_TICKS
+static void ppmPulse(uint32_t width)
+{
+    static uint8_t actChannel = 0;
+    static bool bad = false;
+
+    if (width > PPM_SYNC) {
+        // Six channel frames went out at the sixth pulse
+        if (actChannel < 6) {
+            ppmPublish(actChannel, bad);
+        }
+
+        actChannel = 0;
+        bad = false;
+    } else if (width < PPM_MIN || width > PPM_MAX) {
+        bad = true;
+    } else if (actChannel < 6) {
+        ppmWork[actChannel++] = width;
+
+        if (actChannel == 6) {
+            ppmPublish(6, bad);
+        }
+    }
+}
+
+
+#if defined(PPM_INPUT_CAPTURE)
+// Walk the edges the DMA captured since the last call
+static void ppmCaptureDrain(void)
+{
+    static uint8_t tail = 0;
+    static uint32_t lastEdge = 0;
+    uint8_t head = (PPM_EDGES - DMA1_Channel3->CNDTR) % PPM_EDGES;
+
+    while (tail != head) {
+        uint32_t edge = ppmEdges[tail];
+
+        ppmPulse(edge - lastEdge);
+        lastEdge = edge;
+        tail = (tail + 1) % PPM_EDGES;
+    }
+}
+#else
 void EXTI4_15_IRQHandler(void)
 {
     static uint16_t lastTime = 0;
-    static uint8_t actChannel = 0;
     uint16_t ThisTime = TIM3->CNT;
 
+    TRACE_BEGIN(TR_PPM);
+
     if ((EXTI->PR & EXTI_Line14) != (uint32_t)RESET) {
         EXTI->PR = EXTI_Line14;
 
         if ((GPIOA->IDR & GPIO_Pin_14) != (uint32_t)Bit_RESET) { // spike filter
-            uint16_t PPMVal = ThisTime - lastTime;
+            ppmPulse((uint16_t)(ThisTime - lastTime));
+            lastTime = ThisTime;
+        }
+    }
 
-            if (PPMVal > 5000) {
-                actChannel = 0;
-            } else if (PPMVal > 500 && PPMVal < 2500) {
-                failsave = 0;
+    TRACE_END(TR_PPM);
+}
+#endif
 
-                if (actChannel < 6) {
-                    chanNewValue[actChannel] = 1;
-                    RawChannels[actChannel++] = PPMVal;
-                }
-            }
 
-            lastTime = ThisTime;
-        }
+// Middle of three
+static uint32_t median3(uint32_t a, uint32_t b, uint32_t c)
+{
+    if (a > b) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+
+    return c < a ? a : (c > b ? b : c);
+}
+
+
+// The failsafe overwrote RXcommands, the next frame rewrites every channel
+// instead of only those that moved past the jitter deadband
+void invalidateRXDatas(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 6; i++) {
+        channelBuffer[i] = 0;
     }
 }
 
 
 void getRXDatas()
 {
-    static uint16_t channelBuffer[6] = {1500, 1500, 1500, 1500, 1500, 1500};
+    static uint32_t history[6][2];
+    static uint8_t seen = 0xFF; // odd, never published, the defaults go through once
+    uint32_t channels[6];
+    uint8_t start;
     uint8_t i;
 
+#if defined(PPM_INPUT_CAPTURE)
+    ppmCaptureDrain();
+#endif
+
+    // Whole frames only, a set torn between two frames can't be read
+    do {
+        start = seqReadBegin(&RawChannelsSeq);
+
+        for (i = 0; i < 6; i++) {
+            channels[i] = RawChannels[i];
+        }
+    } while (seqReadRetry(&RawChannelsSeq, start));
+
+    if (start == seen) {
+        return;
+    }
+
+    if (seen == 0xFF) {
+        for (i = 0; i < 6; i++) {
+            history[i][0] = history[i][1] = channels[i];
+        }
+    }
+
+    seen = start;
+
+    // Glitch filter: a jump of more than PPM_GLITCH from the last frame
+    // only gets through once the next frame confirms it
+    for (i = 0; i < 6; i++) {
+        uint32_t raw = channels[i];
+
+        if (abs((int32_t)(raw - history[i][1])) > PPM_GLITCH * PPM_TICKS) {
+            channels[i] = median3(history[i][0], history[i][1], raw);
+        }
+
+        history[i][0] = history[i][1];
+        history[i][1] = raw;
+    }
+
     for (i = 0; i < 6; i++) {
-        if (chanNewValue[chanOrder[i]] &&
-            ((channelBuffer[i] - RawChannels[chanOrder[i]] > 1) ||
-             (channelBuffer[i] - RawChannels[chanOrder[i]] < 1))) {
+        uint16_t us = (channels[chanOrder[i]] + PPM_TICKS / 2) / PPM_TICKS;
+
+        // Ignore 1us of jitter
+        if (abs(channelBuffer[i] - us) > 1) {
             if (i == 0) {
-                RXcommands[i] = constrain(RawChannels[chanOrder[i]] - 1000, 0,
-                                          1000);    // throttle
+                RXcommands[i] = constrain(us - 1000, 0, 1000);    // throttle
             } else {
-                RXcommands[i] = constrain(RawChannels[chanOrder[i]] - 1500, -500, 500);
+                RXcommands[i] = constrain(us - 1500, -500, 500);
             }
 
-            channelBuffer[i] = RawChannels[chanOrder[i]];
-            chanNewValue[chanOrder[i]] = 0;
+            channelBuffer[i] = us;
         }
     }
 }
-
-
-
-
@@ -2,3 +2,4 @@
 
 void init_PPMRX(void);
 void getRXDatas(void);
+void invalidateRXDatas(void);
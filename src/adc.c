@@ -17,8 +17,34 @@
 */
 #include "config.h"
 
+#define VREFINT_CAL (*(uint16_t*)0x1FFFF7BA)  // VREFINT reading at 3.3V, factory
+
 extern int16_t LiPoVolt;
 
+// Battery, VREFINT pairs written by DMA, one pair per TIM1 trigger
+static volatile uint16_t adcSamples[ADC_OVERSAMPLE * 2];
+
+
+void init_ADC_DMA(void)
+{
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_InitTypeDef DMA_InitStructure;
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &ADC1->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) adcSamples;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = ADC_OVERSAMPLE * 2;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+    DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+    DMA_Cmd(DMA1_Channel1, ENABLE);
+}
+
+
 void init_ADC()
 {
 
@@ -33,10 +59,15 @@ void init_ADC()
     gpioinitADC.GPIO_PuPd = GPIO_PuPd_NOPULL ;
     GPIO_Init(GPIOA, &gpioinitADC);
 
+    init_ADC_DMA();
+
+    // A battery + VREFINT scan on every TIM1 TRGO, a fixed point of the
+    // motor PWM period (see init_Timer), so motor current no longer shows
+    // up as noise depending on where the loop happened to start it
     ADC_InitTypeDef ADC_InitStructure;
     ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
     ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
-    ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+    ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_Rising;
     ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T1_TRGO;
     ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
     ADC_InitStructure.ADC_ScanDirection = ADC_ScanDirection_Upward;
@@ -48,38 +79,48 @@ void init_ADC()
 #if defined(CX_10_BLUE_BOARD)
     ADC_ChannelConfig(ADC1, ADC_Channel_7, ADC_SampleTime_239_5Cycles);
 #endif
-
-    ADC_ITConfig(ADC1, ADC_IT_EOC, ENABLE);
-
-    NVIC_InitTypeDef NVIC_InitStructure;
-    NVIC_InitStructure.NVIC_IRQChannel = ADC1_COMP_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPriority = 4;
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
-    NVIC_Init(&NVIC_InitStructure);
+    ADC_ChannelConfig(ADC1, ADC_Channel_Vrefint, ADC_SampleTime_239_5Cycles);
+    ADC_VrefintCmd(ENABLE);
 
     ADC_GetCalibrationFactor(ADC1);
+    ADC_DMARequestModeConfig(ADC1, ADC_DMAMode_Circular);
+    ADC_DMACmd(ADC1, ENABLE);
     ADC_Cmd(ADC1, ENABLE);
 
     while (!ADC_GetFlagStatus(ADC1, ADC_FLAG_ADEN));
 
+    // Armed once, the triggers do the rest
+    ADC_StartOfConversion(ADC1);
 }
 
 
-
-void ADC1_COMP_IRQHandler(void)
+// Average the DMA buffer into LiPoVolt. The battery sum over the VREFINT
+// sum scales the reading to what it would be on the 3.3V supply the scale
+// factors below assume. Both sums hold ADC_OVERSAMPLE samples, so the
+// oversampling cancels in the ratio: bat comes out at the scale of a
+// single sample, averaged but with no fractional bits to shift off.
+void get_ADCDatas(void)
 {
-    if ((uint32_t)(ADC1->ISR & ADC_IT_EOC) != (uint32_t)RESET) {
-        ADC1->ISR = (uint32_t)ADC_IT_EOC;
+    uint32_t sumBat = 0;
+    uint32_t sumRef = 0;
+    uint32_t bat;
+    uint8_t i;
+
+    for (i = 0; i < ADC_OVERSAMPLE * 2; i += 2) {
+        sumBat += adcSamples[i];
+        sumRef += adcSamples[i + 1];
+    }
+
+    if (sumRef == 0) {
+        return;     // no trigger yet
+    }
+
+    bat = sumBat * VREFINT_CAL / sumRef;
+
 #if defined(CX_10_RED_BOARD)
-        LiPoVolt      = ((ADC1->DR) << 7) / 954;
+    LiPoVolt      = (bat << 7) / 954;
 #endif
 #if defined(CX_10_BLUE_BOARD)
-        LiPoVolt      = ((ADC1->DR) << 7) / 153;
+    LiPoVolt      = (bat << 7) / 153;
 #endif
-    }
 }
-
-
-
-
-
@@ -2,3 +2,4 @@
 
 void init_ADC_DMA(void);
 void init_ADC(void);
+void get_ADCDatas(void);
@@ -0,0 +1,135 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Battery state of charge estimate.
+
+    There is no current sensor, the throttle stands in for the load. The
+    voltage drop per unit of throttle (the pack and wiring resistance) is
+    learned from throttle steps, which gives a rest voltage to look up on
+    the discharge curve, and the throttle integrated over time gives the
+    charge used. The two are blended in 16.16 fixed point.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#define SAG_STEP        150     // throttle change that counts as a step
+#define SAG_MAX         100     // 1V at full throttle, beyond is a bad sample
+#define SOC_ONE         (100L << 16)
+
+battery_t battery = {0, BATTERY_SAG, 0, 0, false, false};
+
+// 1S LiPo rest voltage (10mV) to state of charge (percent)
+static const int16_t ocvVolt[] = {420, 410, 398, 390, 385, 381, 379, 377, 373, 370, 360, 330};
+static const uint8_t ocvSoc[]  = {100, 90,  80,  70,  60,  50,  40,  30,  20,  10,  5,   0};
+
+static int32_t socQ = -1;           // percent, 16.16
+static int32_t sagQ = (int32_t)BATTERY_SAG << 8;    // 10mV at full throttle, 24.8
+static uint32_t usedQ = 0;          // mA ticks, 36000 per mAh
+static int16_t lastVolt = 0;
+static int16_t lastThrottle = 0;
+static uint8_t lowTicks = 0;
+
+
+// Percent of charge left at a rest voltage, 16.16
+static int32_t ocvLookup(int16_t volt)
+{
+    uint8_t i;
+
+    if (volt >= ocvVolt[0]) {
+        return SOC_ONE;
+    }
+
+    for (i = 1; i < sizeof(ocvSoc); i++) {
+        if (volt >= ocvVolt[i]) {
+            return ((int32_t)ocvSoc[i] << 16) +
+                   ((int32_t)(ocvSoc[i - 1] - ocvSoc[i]) << 16) * (volt - ocvVolt[i]) /
+                   (ocvVolt[i - 1] - ocvVolt[i]);
+        }
+    }
+
+    return 0;
+}
+
+
+// Call at 10Hz, throttle 0-1000 while the motors run, 0 otherwise
+void batteryUpdate(int16_t throttle)
+{
+    int16_t volt = LiPoVolt;
+    uint32_t current = (uint32_t)throttle * BATTERY_FULL_MA / 1000;
+    int32_t socVolt;
+
+    if (volt == 0) {
+        return;     // no ADC reading yet
+    }
+
+    // A throttle step with the voltage moving the other way measures the sag
+    if (lastVolt && abs(throttle - lastThrottle) > SAG_STEP) {
+        int32_t sample = (int32_t)(lastVolt - volt) * 1000 / (throttle - lastThrottle);
+
+        if (sample > 0 && sample < SAG_MAX) {
+            sagQ += ((sample << 8) - sagQ) / 8;
+        }
+    }
+
+    lastVolt = volt;
+    lastThrottle = throttle;
+
+    battery.sag = sagQ >> 8;
+    battery.restVolt = volt + (int32_t)(sagQ * throttle / 1000 >> 8);
+
+    // Charge used, and the same as a share of the pack
+    usedQ += current;
+    battery.usedMah = usedQ / 36000;
+
+    socVolt = ocvLookup(battery.restVolt);
+
+    if (socQ < 0) {
+        socQ = socVolt;     // first reading, the pack has been resting
+    } else if (throttle == 0) {
+        socQ += (socVolt - socQ) / 4;
+    } else {
+        socQ -= (int32_t)(current << 16) / (360L * BATTERY_CAPACITY);
+        socQ += (socVolt - socQ) / 256;
+    }
+
+    socQ = constrain(socQ, 0, SOC_ONE);
+    battery.soc = socQ >> 16;
+
+    if (battery.soc < BATTERY_WARN_SOC) {
+        battery.warning = true;
+    }
+
+    // The cutoff powers the board down, so the estimate alone may only
+    // trigger it at zero throttle, where restVolt is the reading itself.
+    // Under load only the raw floor can, a sag model gone wrong must not
+    // drop the craft out of the air.
+    if (throttle == 0 && battery.restVolt < BATTERY_CUTOFF) {
+        if (lowTicks < BATTERY_CUTOFF_TIME) {
+            lowTicks++;
+        } else {
+            battery.cutoff = true;
+        }
+    } else {
+        lowTicks = 0;
+    }
+
+    if (volt < BATTERY_FLOOR) {
+        battery.cutoff = true;
+    }
+
+    if (battery.cutoff) {
+        battery.warning = true;
+    }
+}
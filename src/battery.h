@@ -0,0 +1,19 @@
+#ifndef __BATTERY_H__
+#define __BATTERY_H__
+
+// Battery estimate, updated at 10Hz from LiPoVolt and the throttle
+typedef struct {
+    int16_t restVolt;       // LiPoVolt with the throttle sag added back, 10mV
+    uint16_t sag;           // learned sag at full throttle, 10mV
+    uint16_t usedMah;       // estimated consumption since power up
+    uint8_t soc;            // state of charge, percent
+    bool warning;           // latched once soc drops below BATTERY_WARN_SOC
+    bool cutoff;            // at zero throttle restVolt below BATTERY_CUTOFF for
+                            // BATTERY_CUTOFF_TIME, or LiPoVolt below BATTERY_FLOOR
+} battery_t;
+
+extern battery_t battery;
+
+void batteryUpdate(int16_t throttle);
+
+#endif
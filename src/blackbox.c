@@ -0,0 +1,169 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Blackbox logger, loop state streamed over serial.
+
+    The frame encoding follows the same idea as the Betaflight blackbox:
+    an occasional keyframe with absolute values, deltas in between, all
+    as zigzag varints so small changes cost a byte. See blackbox.h.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#if defined(BLACKBOX)
+
+int32_t blackboxFields[BB_FIELD_COUNT];
+
+static int32_t bbLast[BB_FIELD_COUNT];
+static uint8_t bbFrame[1 + BB_FIELD_COUNT * 5];
+static uint8_t bbDivider = 0;
+static uint8_t bbSinceKey = 0;
+static bool bbNeedKey = true;
+
+// Logger cost over the current second, encode times in CPU cycles
+static uint32_t bbStatStart = 0;
+static bool bbStatSeeded = false;
+static uint16_t bbFrames = 0;
+static uint16_t bbDropped = 0;
+static uint32_t bbBytes = 0;
+static uint32_t bbEncodeSum = 0;
+static uint32_t bbEncodeMax = 0;
+
+
+static uint8_t* bbPutVar(uint8_t* p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+
+    *p++ = v;
+    return p;
+}
+
+
+static uint8_t* bbPutSigned(uint8_t* p, int32_t v)
+{
+    return bbPutVar(p, (uint32_t)(v << 1) ^ (uint32_t)(v >> 31));
+}
+
+
+static void bbStatReset(uint32_t now)
+{
+    bbStatStart = now;
+    bbStatSeeded = true;
+    bbFrames = 0;
+    bbDropped = 0;
+    bbBytes = 0;
+    bbEncodeSum = 0;
+    bbEncodeMax = 0;
+}
+
+
+static void bbSendStats(uint32_t now)
+{
+    uint8_t* p = bbFrame;
+
+    *p++ = 'S';
+    p = bbPutVar(p, bbFrames);
+    p = bbPutVar(p, bbDropped);
+    p = bbPutVar(p, bbBytes);
+    p = bbPutVar(p, bbFrames ? bbEncodeSum / bbFrames : 0);
+    p = bbPutVar(p, bbEncodeMax);
+
+    mspSendFrame(MSP2_CX10_BLACKBOX, bbFrame, p - bbFrame);
+    bbStatReset(now);
+}
+
+
+// Next logged frame is a keyframe and starts a stats second, call when
+// logging (re)starts
+void blackboxStart(void)
+{
+    bbNeedKey = true;
+    bbDivider = 0;
+    bbStatSeeded = false;
+}
+
+
+// Encode and queue blackboxFields, every BLACKBOX_DIVIDER calls
+void blackboxLog(void)
+{
+    uint8_t* p = bbFrame;
+    uint32_t start;
+    uint32_t cost;
+    uint32_t now;
+    uint8_t i;
+
+    if (++bbDivider < BLACKBOX_DIVIDER) {
+        return;
+    }
+
+    bbDivider = 0;
+    start = cycles();
+
+    if (bbNeedKey || bbSinceKey >= BLACKBOX_KEYFRAME) {
+        *p++ = 'I';
+
+        for (i = 0; i < BB_FIELD_COUNT; i++) {
+            p = bbPutSigned(p, blackboxFields[i]);
+        }
+
+        bbSinceKey = 0;
+        bbNeedKey = false;
+    } else {
+        *p++ = 'P';
+
+        for (i = 0; i < BB_FIELD_COUNT; i++) {
+            p = bbPutSigned(p, blackboxFields[i] - bbLast[i]);
+        }
+    }
+
+    bbSinceKey++;
+
+    for (i = 0; i < BB_FIELD_COUNT; i++) {
+        bbLast[i] = blackboxFields[i];
+    }
+
+    // A lost delta breaks the chain, restart it with a keyframe
+    if (mspSendFrame(MSP2_CX10_BLACKBOX, bbFrame, p - bbFrame)) {
+        bbBytes += MSP_FRAME_OVERHEAD + (p - bbFrame);
+    } else {
+        bbNeedKey = true;
+        bbDropped++;
+    }
+
+    cost = cyclesSince(start);
+    now = micros();
+
+    // The first frame opens the second, the counts so far are from before
+    // the (re)start
+    if (!bbStatSeeded) {
+        bbStatReset(now);
+    }
+
+    bbFrames++;
+    bbEncodeSum += cost;
+
+    if (cost > bbEncodeMax) {
+        bbEncodeMax = cost;
+    }
+
+    if (now - bbStatStart >= 1000000) {
+        bbSendStats(now);
+    }
+}
+
+#endif
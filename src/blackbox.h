@@ -0,0 +1,37 @@
+#ifndef __BLACKBOX_H__
+#define __BLACKBOX_H__
+
+// Blackbox stream (BLACKBOX), sent in place of the MSP telemetry frames.
+// Every logged cycle is the payload of one MSP2_CX10_BLACKBOX frame, so it
+// shares the port with MSP replies and a decoder syncs on the MSP header
+// and drops frames that fail the CRC. The first payload byte is the type:
+//   'I' keyframe   all fields, signed values as zigzag varints
+//   'P' delta      each field minus its value in the previous frame,
+//                  zigzag varint (time is therefore the cycle period)
+// A keyframe starts every BLACKBOX_KEYFRAME frames, and after any frame
+// that didn't fit in the TX buffer. After a lost or corrupt frame the
+// decoder skips deltas until the next 'I'.
+// Once a second an 'S' frame reports the logger's own cost, as unsigned
+// varints: frames, dropped, bytes, encode average and max in CPU cycles
+// (48 per us).
+// tools/bbdecode turns a capture of the port into CSV.
+// Varints are 7 bits per byte, least significant first, bit 7 set on all
+// but the last byte. Zigzag maps 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+
+enum {
+    BB_TIME,                // us
+    BB_GYRO,                // GyroXYZ[3]
+    BB_SETPOINT = BB_GYRO + 3,
+    BB_P = BB_SETPOINT + 3, // PID terms roll, pitch, yaw
+    BB_I = BB_P + 3,
+    BB_D = BB_I + 3,
+    BB_MOTOR = BB_D + 3,    // front left, front right, rear right, rear left
+    BB_FIELD_COUNT = BB_MOTOR + 4
+};
+
+extern int32_t blackboxFields[BB_FIELD_COUNT];
+
+void blackboxLog(void);
+void blackboxStart(void);
+
+#endif
@@ -9,6 +9,9 @@
 #ifdef CX_10_RED_BOARD
 
 #define CX_10_RED_RF
+//#define RF_HOPPING // TX hops channels, sequence derived from its ID (not the stock TX)
+//#define RF_TELEMETRY // Telemetry frames in the ACK payloads (TX must accept ACK payloads)
+//#define RF_IRQ // Radio IRQ wired to PA1, unverified on some PCB revisions, polled otherwise
 //#define MOTOR_DISABLE // Test mode
 
 #endif
@@ -33,6 +36,36 @@
 #define GYRO_D_PITCH 120
 #define GYRO_D_YAW   0
 
+// Failsafe, ms without RX data before each stage
+#define FAILSAFE_HOLD     100   // link lost, the last command is held
+#define FAILSAFE_LEVEL    300   // rates zeroed, throttle limited to FAILSAFE_THROTTLE
+#define FAILSAFE_DISARM   1000  // motors off and disarm
+#define FAILSAFE_THROTTLE 350
+
+// Phase-lock the control loop to RX packet arrival, only while the measured
+// packet period is a multiple of the 2ms cycle (stock TX 20ms, not 22.5ms PPM)
+//#define LOOP_PHASE_LOCK
+#define LOOP_LOCK_OFFSET  250   // us after the packet a cycle should start
+#define LOOP_LOCK_TRIM    50    // max us the cycle time is stretched or shrunk
+
+// Sleep (WFI) between control cycles instead of spinning, woken by a TIM3
+// compare IDLE_WAKE_MARGIN us early and spinning the rest for a clean start
+#define IDLE_SLEEP
+#define IDLE_WAKE_MARGIN  10
+
+// Battery ADC, triggered by the motor PWM timer and averaged from DMA
+#define ADC_TRIGGER_DIV   12  // PWM periods per sample, 24kHz / 12 = 2kHz
+#define ADC_OVERSAMPLE    16  // samples averaged, 8ms at 2kHz
+
+// Battery estimate (see battery.c), stock pack
+#define BATTERY_CAPACITY    100 // mAh
+#define BATTERY_FULL_MA     2400 // current at full throttle
+#define BATTERY_SAG         30  // initial sag at full throttle, 10mV, learned in flight
+#define BATTERY_WARN_SOC    15  // percent, LEDs flash
+#define BATTERY_CUTOFF      330 // rest voltage at zero throttle, 10mV, BLUE board turns itself off
+#define BATTERY_CUTOFF_TIME 30  // 10Hz ticks below BATTERY_CUTOFF
+#define BATTERY_FLOOR       250 // LiPoVolt, 10mV, BLUE board turns itself off even in flight
+
 // RC Settings
 #define RC_RATE 460 // 100-990
 #define RC_ROLL_RATE 88 // 0-100
@@ -43,6 +76,12 @@
 #define RC_CHAN_ORDER 0,1,2,3,4,5 // deltang ppm
 //#define RC_CHAN_ORDER 2,0,1,3,4,5 // orangerx ppm
 
+// PPM edges latched by TIM2_CH2 and collected by DMA, no interrupt per edge.
+// Needs the receiver moved from PA14 (SWCLK, no timer) to PA1.
+//#define PPM_INPUT_CAPTURE
+#define PPM_MIN_CHANNELS 4 // shorter frames are dropped
+#define PPM_GLITCH 300 // us, bigger jumps need a second frame to get through
+
 
 
 // just for Setting things up
@@ -50,6 +89,31 @@
 // force Serial1 (pin A9 & A10).  unflyable (not needed for the red board)
 //#define FORCE_SERIAL
 
+// Serial telemetry is sent as binary MSP frames (see msp.h), this restores
+// the old readable one field per line dump
+//#define TELEMETRY_ASCII
+#define TELEMETRY_DIVIDER 2 // cycles per MSP frame, 2 = 250Hz (10KB/s of the 11.5KB/s
+                            // at 115200, ~1.5KB/s left for MSP replies, flight recorder
+                            // dumps and the trace)
+
+// Stream every armed cycle's state (see blackbox.h) instead of the telemetry.
+// At 115200 a divider of 1 (500Hz) is more than the port carries.
+//#define BLACKBOX
+#define BLACKBOX_DIVIDER  2  // cycles per logged frame
+#define BLACKBOX_KEYFRAME 32 // logged frames per keyframe
+
+// Keep the last cycles in RAM across a reset and send them after boot
+// (see flightrec.h), 8 bytes of RAM per record
+#define FLIGHT_RECORDER
+#define FLIGHTREC_RECORDS 64 // power of 2, at most 128
+
+// Time the loop stages, read back with MSP2_CX10_PROFILE (see profile.h)
+//#define PROFILER
+
+// Trace interrupt and loop activity, drained as MSP frames (see trace.h)
+//#define TRACE
+#define TRACE_ENTRIES 64 // power of 2, 4 bytes of RAM each
+
 
 
 // ===== CONFIG END ===== //
@@ -59,6 +123,18 @@
 #define SERIAL_ACTIVE
 #endif
 
+// TIM2 drives a motor on the red board, and its SPI1 TX uses DMA1 ch3
+#if defined(PPM_INPUT_CAPTURE) && (defined(CX_10_RED_BOARD) || defined(CX_10_RED_RF))
+#error "PPM_INPUT_CAPTURE needs TIM2 and DMA1 ch3, both taken on the red board"
+#endif
+
+#if !defined(SERIAL_ACTIVE)
+#undef BLACKBOX // nowhere to stream to
+#undef FLIGHT_RECORDER
+#undef PROFILER
+#undef TRACE
+#endif
+
 #if defined(CX_10_RED_BOARD)
 #define LEDon Bit_SET
 #define LEDoff Bit_RESET
@@ -75,6 +151,19 @@
 #define RADIO_GPIO_SPI_MISO       GPIO_Pin_6
 #define RADIO_GPIO_SPI_MOSI       GPIO_Pin_7
 
+// BK2423 IRQ output (active low), routed to EXTI so packets are read on arrival.
+// Without these the radio is polled in a window around the predicted packet.
+// A wrong pin means no packets at all, not even bind, so it is opt-in.
+#if defined(RF_IRQ)
+#define RADIO_GPIO_IRQ_PORT       GPIOA
+#define RADIO_GPIO_IRQ            GPIO_Pin_1
+#define RADIO_EXTI_PORTSOURCE     EXTI_PortSourceGPIOA
+#define RADIO_EXTI_PINSOURCE      EXTI_PinSource1
+#define RADIO_EXTI_LINE           EXTI_Line1
+#define RADIO_EXTI_IRQn           EXTI0_1_IRQn
+#define RADIO_EXTI_IRQHandler     EXTI0_1_IRQHandler
+#endif
+
 #define GYRO_ORIENTATION(X, Y, Z) {GyroXYZ[0] = -X; GyroXYZ[1] = -Y; GyroXYZ[2] = -Z;}
 #define ACC_ORIENTATION(X, Y, Z)  {ACCXYZ[0]  = -Y; ACCXYZ[1]  =  -X; ACCXYZ[2]  =  -Z;}
 #endif
@@ -117,18 +206,44 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include "seqlock.h"
+#include "rfframe.h"
+#include "msp.h"
+#include "blackbox.h"
+#include "flightrec.h"
+#include "profile.h"
+#include "trace.h"
+#include "battery.h"
 
 //defines
+#define FS_OK       0
+#define FS_HOLD     1
+#define FS_LEVEL    2
+#define FS_DISARM   3
+
 #define abs(x) ((x) > 0 ? (x) : -(x))
 #define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
 
 //globals
 extern int16_t RXcommands[6];
 extern int8_t Armed;
+extern uint8_t G_P[3];
+extern uint8_t G_I[3];
+extern uint8_t G_D[3];
+extern uint16_t RC_Rate;
+extern uint8_t RPY_Rate[3];
 extern int16_t LiPoVolt;
 extern int16_t GyroXYZ[3];
 extern int16_t ACCXYZ[3];
 extern int16_t I2C_Errors;
 extern uint16_t calibGyroDone;
-extern uint8_t failsave;
+extern volatile uint32_t RXlastUpdate;
+extern uint8_t failsafeStage;
+extern uint16_t RXlatencyHist[16];
+extern uint16_t RXperiod;
+extern bool bind;
+extern uint16_t loopOverruns;
+extern uint8_t idleSleepPct;
+extern uint16_t cycleStartLate;
+extern uint16_t serialTxDropped;
 extern int16_t angle[3];
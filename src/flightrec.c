@@ -0,0 +1,161 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Flight recorder, last cycles kept in RAM across a reset.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#if defined(FLIGHT_RECORDER)
+
+#define FLIGHTREC_MAGIC  0x464C5243   // "FLRC"
+
+// Placed in .noinit, neither zeroed nor loaded by the startup code
+typedef struct {
+    uint32_t magic;
+    uint32_t head;          // next record to write, counts up forever
+    uint32_t flags;
+    uint32_t cost;          // flightRecCost when the run ended
+    uint32_t records[FLIGHTREC_RECORDS][2];
+} flightRec_t;
+
+static flightRec_t flightRec __attribute__((section(".noinit")));
+
+uint16_t flightRecCost = 0;     // TIM3 ticks (us) per 256 records
+
+static bool frRecording = false;
+static uint8_t frDumpCount = 0;
+static uint8_t frDumpNext = 0;
+static uint8_t frResetFlags = 0;
+static uint16_t frLastOverruns = 0;
+static uint16_t frCostSum = 0;
+static uint8_t frCostCount = 0;
+
+
+static uint32_t frSat8(int32_t v)
+{
+    return (uint8_t)constrain(v, -128, 127);
+}
+
+
+// Keep the previous run's records if they survived the reset, otherwise
+// start recording straight away
+void init_FlightRec(void)
+{
+    frResetFlags = (RCC->CSR >> 24) & ~FLIGHTREC_FAULT;    // bit 0 is RMVF
+    RCC->CSR |= RCC_CSR_RMVF;
+
+    if (flightRec.magic == FLIGHTREC_MAGIC && !(frResetFlags & (RCC_CSR_PORRSTF >> 24))) {
+        frResetFlags |= flightRec.flags;
+        frDumpCount = flightRec.head < FLIGHTREC_RECORDS ? flightRec.head : FLIGHTREC_RECORDS;
+    }
+
+    if (frDumpCount == 0) {
+        flightRecDump();
+    }
+}
+
+
+// Two packed word stores per cycle, the record is built in registers
+void flightRecRecord(int16_t* pid)
+{
+    uint16_t start = TIM3->CNT;
+    uint32_t w0, w1;
+    uint32_t* r;
+
+    if (!frRecording) {
+        return;
+    }
+
+    w0 = (flightRec.head & 0x0F) | (Armed << 4) | (failsafeStage << 5) |
+         ((loopOverruns != frLastOverruns) << 7) |
+         ((uint32_t)(uint8_t)(RXcommands[0] >> 2) << 8) |
+         (frSat8(GyroXYZ[0] >> 4) << 16) | (frSat8(GyroXYZ[1] >> 4) << 24);
+    w1 = frSat8(GyroXYZ[2] >> 4) | (frSat8(pid[0] >> 2) << 8) |
+         (frSat8(pid[1] >> 2) << 16) | (frSat8(pid[2] >> 2) << 24);
+    frLastOverruns = loopOverruns;
+
+    r = flightRec.records[flightRec.head++ % FLIGHTREC_RECORDS];
+    r[0] = w0;
+    r[1] = w1;
+
+    frCostSum += (uint16_t)(TIM3->CNT - start);
+
+    if (++frCostCount == 0) {
+        flightRecCost = frCostSum;
+        flightRec.cost = frCostSum;
+        frCostSum = 0;
+    }
+}
+
+
+// Call every cycle. Sends the surviving records a frame at a time as the
+// TX buffer empties, then clears them and starts recording.
+void flightRecDump(void)
+{
+    uint8_t payload[5 + FLIGHTREC_PER_FRAME * 8];
+    uint32_t first;
+    uint8_t n = 0;
+    uint8_t i;
+
+    if (frRecording) {
+        return;
+    }
+
+    if (frDumpNext < frDumpCount) {
+        if (serial_tx_free() < MSP_FRAME_OVERHEAD + sizeof(payload)) {
+            return;
+        }
+
+        first = flightRec.head - frDumpCount;
+        payload[0] = frResetFlags;
+        payload[1] = frDumpCount;
+        payload[2] = frDumpNext;
+        payload[3] = flightRec.cost;
+        payload[4] = flightRec.cost >> 8;
+
+        while (n < FLIGHTREC_PER_FRAME && frDumpNext < frDumpCount) {
+            uint32_t* r = flightRec.records[(first + frDumpNext++) % FLIGHTREC_RECORDS];
+
+            for (i = 0; i < 4; i++) {
+                payload[5 + n * 8 + i] = r[0] >> (i * 8);
+                payload[9 + n * 8 + i] = r[1] >> (i * 8);
+            }
+
+            n++;
+        }
+
+        mspSendFrame(MSP2_CX10_FLIGHTREC, payload, 5 + n * 8);
+        return;
+    }
+
+    flightRec.magic = FLIGHTREC_MAGIC;
+    flightRec.head = 0;
+    flightRec.flags = 0;
+    flightRec.cost = 0;
+    frRecording = true;
+}
+
+
+// From the HardFault handler: note the fault, and reset so the records
+// get dumped instead of the CPU spinning with the motors at their last
+// output
+void flightRecFault(void)
+{
+    flightRec.flags |= FLIGHTREC_FAULT;
+    NVIC_SystemReset();
+}
+
+#endif
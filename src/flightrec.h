@@ -0,0 +1,27 @@
+#ifndef __FLIGHTREC_H__
+#define __FLIGHTREC_H__
+
+// Flight recorder (FLIGHT_RECORDER). The last FLIGHTREC_RECORDS control
+// cycles are kept in .noinit RAM, which survives a software, fault or
+// watchdog reset, and sent after the next boot as MSP2_CX10_FLIGHTREC
+// frames: uint8 reset flags (RCC_CSR >> 24, FLIGHTREC_FAULT added),
+// uint8 record count, uint8 index of the first record in this frame,
+// uint16 recording cost (flightRecCost of that run, 0 if it recorded
+// fewer than 256 cycles), then up to 3 records, oldest first. A record
+// is 8 bytes:
+//   byte 0   bits 0-3 cycle sequence, bit 4 Armed, bits 5-6 failsafeStage,
+//            bit 7 loop overrun since the previous record
+//   byte 1   throttle / 4
+//   byte 2-4 gyro X, Y, Z / 16, saturated
+//   byte 5-7 PID roll, pitch, yaw / 4, saturated
+#define FLIGHTREC_FAULT        0x01   // HardFault forced the reset
+#define FLIGHTREC_PER_FRAME    3
+
+extern uint16_t flightRecCost;    // TIM3 ticks (us) per 256 records
+
+void init_FlightRec(void);
+void flightRecRecord(int16_t* pid);
+void flightRecDump(void);
+void flightRecFault(void);
+
+#endif
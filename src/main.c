@@ -49,11 +49,13 @@
 
 #include "config.h"
 
+#if defined(TELEMETRY_ASCII)
 static uint8_t TelMtoSend = 0;
+#endif
 static uint16_t minCycleTime = 2000;
-static uint16_t T3OV = 0;
+static volatile uint32_t T3OV = 0;    // TIM3 wraps, upper bits of the us time
 static int8_t answerStayTime = 0;
-static uint16_t LiPoEmptyWaring = 0;
+#if defined(TELEMETRY_ASCII)
 uint8_t nx[2] = {'\n', '\r'};
 uint8_t TelRXThrottle[10] = {'T', 'h', 'r', 'o', 't', 't', 'l', 'e', ' ', ' '};
 uint8_t TelRXRoll[10] = {'R', 'o', 'l', 'l', ' ', ' ', ' ', ' ', ' ', ' '};
@@ -69,6 +71,7 @@ uint8_t TelAX[10] = {'A', 'C', 'C', ' ', 'X', ' ', ' ', ' ', ' ', ' '};
 uint8_t TelAY[10] = {'A', 'C', 'C', ' ', 'Y', ' ', ' ', ' ', ' ', ' '};
 uint8_t TelAZ[10] = {'A', 'C', 'C', ' ', 'Z', ' ', ' ', ' ', ' ', ' '};
 uint8_t TelDefaultAnswer[10] = {'H', 'o', 'd', 'o', 'r', '!', ' ', ' ', ' ', ' '};
+#endif
 
 int16_t RXcommands[6] = {0, 500, 500, 500, -500, 500};
 int8_t Armed = 0;
@@ -78,7 +81,13 @@ int16_t ACCXYZ[3] = {0, 0, 0};
 int16_t angle[3] = {0, 0, 0};
 int16_t I2C_Errors = 0;
 uint16_t calibGyroDone = 500;
-uint8_t failsave = 100;
+volatile uint32_t RXlastUpdate = 0;
+uint8_t failsafeStage = FS_DISARM;
+uint16_t RXlatencyHist[16];    // RX data to PWM update, 250us buckets
+uint16_t RXperiod = 0;         // measured RX data period, us (LOOP_PHASE_LOCK)
+uint16_t loopOverruns = 0;
+uint8_t idleSleepPct = 0;      // share of the last 256 cycles spent asleep
+uint16_t cycleStartLate = 0;   // worst late cycle start of the last 256, us
 
 
 uint8_t mode = 0;
@@ -95,16 +104,43 @@ int16_t Imax[3] = {18000, 18000, 5000};
 
 void TIM3_IRQHandler(void)
 {
+    TRACE_BEGIN(TR_TIM3);
+
     if (TIM3->SR & TIM_IT_Update) {
         TIM3->SR = (uint16_t)~TIM_IT_Update;
         T3OV++;
     }
+
+    // Idle wake up, nothing else to do
+    if (TIM3->SR & TIM_IT_CC1) {
+        TIM3->SR = (uint16_t)~TIM_IT_CC1;
+    }
+
+    TRACE_END(TR_TIM3);
 }
 
 
+// The us timebase read, see timebase.h
+#define TB_OVERFLOWS    T3OV
+#define TB_COUNT()      TIM3->CNT
+#define TB_PENDING()    (TIM3->SR & TIM_IT_Update)
+#include "timebase.h"
+
 uint32_t micros()
 {
-    return (T3OV << 16) + (TIM3->CNT);
+    uint16_t cnt;
+    uint32_t overflows = readTimebase(&cnt);
+
+    return (overflows << 16) | cnt;
+}
+
+// Doesn't wrap in the life of a battery (or the craft)
+uint64_t micros64(void)
+{
+    uint16_t cnt;
+    uint32_t overflows = readTimebase(&cnt);
+
+    return ((uint64_t)overflows << 16) | cnt;
 }
 
 uint32_t millis()
@@ -119,6 +155,105 @@ void delayMicroseconds(uint32_t us)
     while (micros() - now < us);
 }
 
+// Failsafe stage from the time since the RX last delivered data
+static uint8_t getFailsafeStage(void)
+{
+    uint32_t age = micros() - RXlastUpdate;
+
+    if (age < FAILSAFE_HOLD * 1000UL) {
+        return FS_OK;
+    } else if (age < FAILSAFE_LEVEL * 1000UL) {
+        return FS_HOLD;
+    } else if (age < FAILSAFE_DISARM * 1000UL) {
+        return FS_LEVEL;
+    }
+
+    return FS_DISARM;
+}
+
+#if defined(LOOP_PHASE_LOCK)
+// Learn the RX data period from consecutive updates. Gaps that don't look
+// like one period (lost packets) are ignored, a run of them starts over.
+static void phaseLockLearn(uint32_t RXseen)
+{
+    static uint32_t last = 0;
+    static uint8_t misfits = 0;
+    uint32_t gap = RXseen - last;
+
+    last = RXseen;
+
+    if (RXperiod && gap > RXperiod - RXperiod / 4U && gap < RXperiod + RXperiod / 4U) {
+        RXperiod += ((int32_t)gap - RXperiod) / 8;
+        misfits = 0;
+    } else if (RXperiod == 0 || ++misfits > 8) {
+        RXperiod = gap < 50000 ? gap : 0;
+        misfits = 0;
+    }
+}
+
+// Length of the next cycle, nudged within LOOP_LOCK_TRIM so that cycles
+// start LOOP_LOCK_OFFSET after the RX data arrives. This needs the packet
+// period to be a multiple of the cycle time (the stock TX's 20ms is, 22.5ms
+// PPM is not): only then is the phase of this cycle start relative to the
+// last packet also the phase relative to the next one. Any other measured
+// period, up to the LOOP_LOCK_TRIM the loop can follow per packet, runs free.
+static uint16_t phaseLockCycleTime(uint32_t CycleStart)
+{
+    uint16_t rem = RXperiod % minCycleTime;
+    int32_t error;
+
+    if (failsafeStage != FS_OK || RXperiod == 0 ||
+        (rem > LOOP_LOCK_TRIM && minCycleTime - rem > LOOP_LOCK_TRIM)) {
+        return minCycleTime;
+    }
+
+    error = (int32_t)(CycleStart - RXlastUpdate) - LOOP_LOCK_OFFSET;
+    error = ((error % minCycleTime) + minCycleTime) % minCycleTime;
+
+    if (error >= minCycleTime / 2) {
+        error -= minCycleTime;
+    }
+
+    // Started late, shorten. Started early, stretch.
+    return minCycleTime - constrain(error / 8, -LOOP_LOCK_TRIM, LOOP_LOCK_TRIM);
+}
+#endif
+
+#if defined(IDLE_SLEEP)
+// Sleep until IDLE_WAKE_MARGIN before the cycle ends. The radio, serial
+// DMA and TIM3 interrupts still run, and any of them wakes the core, the
+// caller then just comes back here. Returns the us spent asleep.
+static uint32_t idleSleep(uint32_t CycleStart, uint16_t cycleTime)
+{
+    uint16_t wakeAt = CycleStart + cycleTime - IDLE_WAKE_MARGIN;
+    uint32_t start = micros();
+
+    if (start - CycleStart + IDLE_WAKE_MARGIN >= cycleTime) {
+        return 0;
+    }
+
+    TIM3->CCR1 = wakeAt;
+    TIM3->SR = (uint16_t)~TIM_IT_CC1;
+    TIM3->DIER |= TIM_IT_CC1;
+
+    // Compare already passed while arming, it would not fire until the
+    // wrap. Checked with interrupts masked: an interrupt after the check
+    // stays pending and ends the WFI, instead of running before it and
+    // leaving the core asleep past the cycle end. It runs on the enable.
+    __disable_irq();
+
+    if ((int16_t)(wakeAt - TIM3->CNT) > 0) {
+        __WFI();
+    }
+
+    __enable_irq();
+
+    TIM3->DIER &= ~TIM_IT_CC1;
+
+    return micros() - start;
+}
+#endif
+
 
 int main(void)
 {
@@ -138,6 +273,10 @@ int main(void)
     init_UART(115200);
 #endif
 
+#if defined(FLIGHT_RECORDER)
+    init_FlightRec();
+#endif
+
 #ifndef CX_10_RED_RF
     init_PPMRX();
 #endif
@@ -165,7 +304,7 @@ int main(void)
     GPIO_WriteBit(GPIOA, GPIO_Pin_5, Bit_SET);
 #endif
 
-    // Initialise the RF RX and bind
+    // Initialise the RF RX, binding completes from the main loop
 #ifdef CX_10_RED_RF
     init_RFRX();
 #endif
@@ -179,9 +318,23 @@ int main(void)
         static int16_t setpoint[3] = {0, 0, 0};
         static int16_t PIDdata[3] = {0, 0, 0};
         static int16_t LastDt[3];
+        static uint32_t latencySeen = 0;
         uint8_t i = 0;
+        uint16_t cycleTime = minCycleTime;
 
         uint32_t CycleStart = micros();
+        uint32_t RXseen = RXlastUpdate;
+
+        TRACE_BEGIN(TR_LOOP);
+
+#ifdef CX_10_RED_RF
+        poll_RFRX();
+
+        // Bind runs alongside the calibration delay and gyro calibration
+        if (!bind) {
+            bind_RFRX();
+        }
+#endif
 
         if (calibGyroDone > 0 && CalibDelay == 0) {
             ReadMPU();
@@ -190,8 +343,11 @@ int main(void)
         if (CalibDelay == 0 && calibGyroDone == 0) {
 
             //collect datas
+            PROFILE_BEGIN(PROF_MPU);
             ReadMPU();
+            PROFILE_END(PROF_MPU);
 
+            PROFILE_BEGIN(PROF_RX);
 #ifndef CX_10_RED_RF
             getRXDatas();
 #endif
@@ -199,8 +355,33 @@ int main(void)
 #ifdef CX_10_RED_RF
             get_RFRXDatas();
 #endif
+            PROFILE_END(PROF_RX);
+
+            // Staged failsafe, evaluated every cycle
+            failsafeStage = getFailsafeStage();
+
+            if (failsafeStage >= FS_LEVEL) {
+                RXcommands[1] = 0;
+                RXcommands[2] = 0;
+                RXcommands[3] = 0;
+
+                if (RXcommands[0] > FAILSAFE_THROTTLE) {
+                    RXcommands[0] = FAILSAFE_THROTTLE;
+                }
+
+#ifndef CX_10_RED_RF
+                invalidateRXDatas();
+#endif
+            }
+
+            if (failsafeStage == FS_DISARM) {
+                RXcommands[0] = 0;      // fall down
+                RXcommands[4] = -500; // Disarm
+            }
 
             // get setpoint
+            PROFILE_BEGIN(PROF_PID);
+
             for (i = 0; i < 3; i++) {
                 RPY_useRates[i] = 100 - (uint32_t)((abs(RXcommands[i + 1]) * 2) * RPY_Rate[i]) /
                                   1000;
@@ -238,6 +419,12 @@ int main(void)
                 LastDt[i] = tmpDT;
                 lastError[i] = error;
 
+#if defined(BLACKBOX)
+                blackboxFields[BB_P + i] = PT;
+                blackboxFields[BB_I + i] = IT;
+                blackboxFields[BB_D + i] = DT;
+#endif
+
                 //combine
                 if (i == 2) {
                     PIDdata[i] = constrain(PT + IT + DT, -500, +500);
@@ -246,11 +433,18 @@ int main(void)
                 }
             }
 
+            PROFILE_END(PROF_PID);
+
+            PROFILE_BEGIN(PROF_MIX);
+
             // Arm with Aux 1
             if (RXcommands[4] > 150) {
-                if (Armed == 0 && OkToArm == 250 &&  failsave < 10 && RXcommands[0] <= 150) {
+                if (Armed == 0 && OkToArm == 250 && failsafeStage == FS_OK && RXcommands[0] <= 150) {
                     Armed = 1;
                     GPIO_WriteBit(LED1_PORT, LED1_BIT, LEDon);
+#if defined(BLACKBOX)
+                    blackboxStart();
+#endif
                 }
             } else {
                 if (Armed == 1) {
@@ -258,7 +452,7 @@ int main(void)
                     GPIO_WriteBit(LED1_PORT, LED1_BIT, LEDoff);
                 }
 
-                if (OkToArm < 250 &&  failsave < 10) {
+                if (OkToArm < 250 && failsafeStage == FS_OK) {
                     OkToArm++;
                 }
             }
@@ -279,11 +473,6 @@ int main(void)
 
             // write Motors
 
-            if (failsave > 10) {
-                RXcommands[0] = 0;      // fall down
-                RXcommands[4] = -500; // Disarm
-            }
-
 #ifdef MOTOR_DISABLE
             RXcommands[0] = 0;
 #endif
@@ -301,17 +490,82 @@ int main(void)
             TIM1->CCR2 = constrain(MIX(-1, +1, -1), motorMin, motorMax); // rear right
             TIM1->CCR1 = constrain(MIX(+1, +1, +1), motorMin, motorMax); // rear left
 #endif
-        } else {
-            failsave = 100;
+            PROFILE_END(PROF_MIX);
+
+#if defined(BLACKBOX)
+
+            if (Armed) {
+                blackboxFields[BB_TIME] = CycleStart;
+
+                for (i = 0; i < 3; i++) {
+                    blackboxFields[BB_GYRO + i] = GyroXYZ[i];
+                    blackboxFields[BB_SETPOINT + i] = setpoint[i];
+                }
+
+#if defined(CX_10_RED_BOARD)
+                blackboxFields[BB_MOTOR + 0] = TIM1->CCR1;
+                blackboxFields[BB_MOTOR + 1] = TIM1->CCR4;
+                blackboxFields[BB_MOTOR + 2] = TIM16->CCR1;
+                blackboxFields[BB_MOTOR + 3] = TIM2->CCR4;
+#else
+                blackboxFields[BB_MOTOR + 0] = TIM1->CCR4;
+                blackboxFields[BB_MOTOR + 1] = TIM1->CCR3;
+                blackboxFields[BB_MOTOR + 2] = TIM1->CCR2;
+                blackboxFields[BB_MOTOR + 3] = TIM1->CCR1;
+#endif
+                PROFILE_BEGIN(PROF_TELEMETRY);
+                blackboxLog();
+                PROFILE_END(PROF_TELEMETRY);
+            }
+
+#endif
+
+#if defined(FLIGHT_RECORDER)
+            flightRecRecord(PIDdata);
+#endif
+
+            // Latency of the first PWM update carrying new RX data
+            if (RXseen != latencySeen) {
+                uint32_t latency = (micros() - RXseen) / 250;
+
+                latencySeen = RXseen;
+
+#if defined(LOOP_PHASE_LOCK)
+                phaseLockLearn(RXseen);
+#endif
+
+                if (latency > 15) {
+                    latency = 15;
+                }
+
+                if (RXlatencyHist[latency] < 0xFFFF) {
+                    RXlatencyHist[latency]++;
+                }
+            }
         }
 
-        ADC_StartOfConversion(ADC1);
+        PROFILE_BEGIN(PROF_ADC);
+        get_ADCDatas();
+        PROFILE_END(PROF_ADC);
+
+#if defined(SERIAL_ACTIVE) && !defined(TELEMETRY_ASCII) && !defined(BLACKBOX)
+        static uint8_t telDivider = 0;
+
+        if (++telDivider >= TELEMETRY_DIVIDER) {
+            PROFILE_BEGIN(PROF_TELEMETRY);
+            telDivider = 0;
+            mspSendTelemetry();
+            PROFILE_END(PROF_TELEMETRY);
+        }
+
+#endif
 
         if (millis() - last_Time > 100) { // 10Hz
-            failsave++; // RX should send with ~50Hz so it should not be higher then 10 as long as there is a good signal
             last_Time = millis();
 
+#if defined(TELEMETRY_ASCII)
             TelMtoSend = 15;
+#endif
 
             if (answerStayTime > 0) {
                 answerStayTime--;
@@ -329,7 +583,9 @@ int main(void)
 
             static uint8_t blinker = 0;
 
-            if (LiPoEmptyWaring == 350) {
+            batteryUpdate(Armed && RXcommands[0] >= MIN_COMMAND ? constrain(RXcommands[0], 0, 1000) : 0);
+
+            if (battery.warning) {
                 blinker++;
 
                 if (blinker % 2) {
@@ -342,29 +598,54 @@ int main(void)
 
 #if defined(CX_10_BLUE_BOARD) // turn off to save the lipo
 
-                if (LiPoVolt < 250) {
+                if (battery.cutoff) {
                     GPIO_WriteBit(GPIOA, GPIO_Pin_5, Bit_RESET);
                 }
 
 #endif
-            } else if (LiPoVolt < 300) {
-                LiPoEmptyWaring++;
-            } else if (LiPoEmptyWaring > 10) {
-                LiPoEmptyWaring -= 10;
             }
         }
 
-#if defined(SERIAL_ACTIVE)
+#if defined(SERIAL_ACTIVE) && defined(TELEMETRY_ASCII)
 
         while (serial_available()) {
             serial_read();
             answerStayTime = 20;
         }
 
+#elif defined(SERIAL_ACTIVE)
+        mspProcessInput();
 #endif
 
-        while (micros() - CycleStart < minCycleTime) {
-#if defined(SERIAL_ACTIVE)
+#if defined(FLIGHT_RECORDER)
+        flightRecDump();
+#endif
+
+#if defined(TRACE)
+        traceDrain();
+#endif
+
+        bool overrun = micros() - CycleStart > minCycleTime;
+
+        if (overrun) {
+            loopOverruns++;
+        }
+
+#if defined(LOOP_PHASE_LOCK)
+        cycleTime = phaseLockCycleTime(CycleStart);
+#endif
+
+        TRACE_END(TR_LOOP);
+
+        static uint32_t sleepSum = 0;
+        static uint16_t lateMax = 0;
+        static uint8_t idleCycles = 0;
+
+        while (micros() - CycleStart < cycleTime) {
+#if defined(IDLE_SLEEP)
+            sleepSum += idleSleep(CycleStart, cycleTime);
+#endif
+#if defined(SERIAL_ACTIVE) && defined(TELEMETRY_ASCII)
 
             if (TelMtoSend > 1 || (answerStayTime > 0 && TelMtoSend > 0)) {
                 TelMtoSend--;
@@ -465,6 +746,21 @@ int main(void)
 
 #endif
         }
+
+        // Sleep share and cycle start jitter, over 256 cycles. Overruns are
+        // in loopOverruns, late is what the wait itself added.
+        uint32_t late = micros() - CycleStart - cycleTime;
+
+        if (!overrun && late > lateMax) {
+            lateMax = late > 0xFFFF ? 0xFFFF : late;
+        }
+
+        if (++idleCycles == 0) {
+            idleSleepPct = sleepSum * 100 / (256UL * minCycleTime);
+            cycleStartLate = lateMax;
+            sleepSum = 0;
+            lateMax = 0;
+        }
     }
 }
 
@@ -1,5 +1,7 @@
 
 uint32_t micros(void);
+uint64_t micros64(void);
+uint32_t millis(void);
 void delayMicroseconds(uint32_t us);
 
 
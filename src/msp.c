@@ -0,0 +1,343 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Binary serial telemetry.
+
+    Frames follow the MSP v2 layout so the common ground tools (and
+    any MSP parser) can sync to and check them. All fields go in one
+    frame, 40 bytes against ~230 for the ASCII dump.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#if defined(SERIAL_ACTIVE)
+
+static uint8_t mspFrame[MSP_FRAME_OVERHEAD + MSP_TELEMETRY_SIZE];
+
+typedef enum {
+    MSP_IDLE,
+    MSP_HEADER_X,
+    MSP_HEADER_DIR,
+    MSP_FLAG,
+    MSP_CMD_LO,
+    MSP_CMD_HI,
+    MSP_SIZE_LO,
+    MSP_SIZE_HI,
+    MSP_PAYLOAD,
+    MSP_CHECKSUM
+} mspState_t;
+
+static mspState_t mspState = MSP_IDLE;
+static uint16_t mspCmd;
+static uint16_t mspSize;
+static uint16_t mspOffset;
+static uint8_t mspCrc;
+static uint8_t mspIn[MSP_RX_PAYLOAD_MAX];
+
+
+static uint8_t mspCrc8(uint8_t crc, uint8_t a)
+{
+    uint8_t i;
+
+    crc ^= a;
+
+    for (i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    }
+
+    return crc;
+}
+
+
+static uint8_t* mspPut16(uint8_t* p, int16_t v)
+{
+    *p++ = v;
+    *p++ = (uint16_t)v >> 8;
+    return p;
+}
+
+
+// Frame and queue a reply, dir is '>' or '!'. The header, the payload
+// where it already is and the CRC are queued in turn once the whole frame
+// is known to fit, so no frame is ever cut and none needs copying.
+static bool mspReply(uint8_t dir, uint16_t cmd, uint8_t* payload, uint8_t size)
+{
+    uint8_t header[MSP_FRAME_OVERHEAD - 1];
+    uint8_t* p = header;
+    uint8_t crc = 0;
+    uint8_t i;
+
+    if (serial_tx_free() < MSP_FRAME_OVERHEAD + size) {
+        serialTxDropped += MSP_FRAME_OVERHEAD + size;
+        return false;
+    }
+
+    *p++ = '$';
+    *p++ = 'X';
+    *p++ = dir;
+    *p++ = 0;
+    p = mspPut16(p, cmd);
+    p = mspPut16(p, size);
+
+    for (i = 3; i < sizeof(header); i++) {
+        crc = mspCrc8(crc, header[i]);
+    }
+
+    for (i = 0; i < size; i++) {
+        crc = mspCrc8(crc, payload[i]);
+    }
+
+    serial_send_bytes(header, sizeof(header));
+    serial_send_bytes(payload, size);
+    serial_send_bytes(&crc, 1);
+
+    return true;
+}
+
+
+// Unsolicited frame, false if the TX buffer can't take all of it
+bool mspSendFrame(uint16_t cmd, uint8_t* payload, uint8_t size)
+{
+    return mspReply('>', cmd, payload, size);
+}
+
+
+static void mspHandle(void)
+{
+    uint8_t out[MSP_TX_PAYLOAD_MAX];
+    uint8_t* p = out;
+    uint8_t size = 0;
+    uint8_t i;
+
+    switch (mspCmd) {
+    case MSP_PID:
+        for (i = 0; i < 3; i++) {
+            out[size++] = G_P[i];
+            out[size++] = G_I[i];
+            out[size++] = G_D[i];
+        }
+
+        break;
+
+    case MSP_SET_PID:
+        if (Armed || mspSize != 9) {
+            mspReply('!', mspCmd, NULL, 0);
+            return;
+        }
+
+        for (i = 0; i < 3; i++) {
+            G_P[i] = mspIn[i * 3];
+            G_I[i] = mspIn[i * 3 + 1];
+            G_D[i] = mspIn[i * 3 + 2];
+        }
+
+        break;
+
+    case MSP2_CX10_RATES:
+        out[size++] = RC_Rate;
+        out[size++] = RC_Rate >> 8;
+
+        for (i = 0; i < 3; i++) {
+            out[size++] = RPY_Rate[i];
+        }
+
+        break;
+
+    case MSP2_CX10_SET_RATES:
+        if (Armed || mspSize != 5) {
+            mspReply('!', mspCmd, NULL, 0);
+            return;
+        }
+
+        RC_Rate = constrain(mspIn[0] | (mspIn[1] << 8), 100, 990);
+
+        for (i = 0; i < 3; i++) {
+            RPY_Rate[i] = constrain(mspIn[i + 2], 0, 100);
+        }
+
+        break;
+
+    case MSP2_CX10_LATENCY:
+        for (i = 0; i < 16; i++) {
+            p = mspPut16(p, RXlatencyHist[i]);
+        }
+
+        p = mspPut16(p, RXperiod);
+        size = p - out;
+        break;
+
+#if defined(CX_10_RED_RF)
+
+    case MSP2_CX10_LINK:
+        size = rfLinkReport(out);
+        break;
+#endif
+
+#if defined(RF_HOPPING)
+
+    case MSP2_CX10_HOP:
+        size = rfHopReport(out);
+        break;
+#endif
+
+#if defined(PROFILER)
+
+    case MSP2_CX10_PROFILE:
+        size = mspSize == 1 ? profileReport(mspIn[0], out) : 0;
+
+        if (size == 0) {
+            mspReply('!', mspCmd, NULL, 0);
+            return;
+        }
+
+        break;
+#endif
+
+    default:
+        mspReply('!', mspCmd, NULL, 0);
+        return;
+    }
+
+    mspReply('>', mspCmd, out, size);
+}
+
+
+// Feed the bytes received so far through the request parser. Never waits,
+// a frame split across calls just resumes where it left off.
+void mspProcessInput(void)
+{
+    while (serial_available()) {
+        uint8_t c = serial_read();
+
+        // CRC runs over flag through payload
+        if (mspState >= MSP_FLAG && mspState <= MSP_PAYLOAD) {
+            mspCrc = mspCrc8(mspCrc, c);
+        }
+
+        switch (mspState) {
+        case MSP_IDLE:
+            mspState = (c == '$') ? MSP_HEADER_X : MSP_IDLE;
+            break;
+
+        case MSP_HEADER_X:
+            mspState = (c == 'X') ? MSP_HEADER_DIR : MSP_IDLE;
+            break;
+
+        case MSP_HEADER_DIR:
+            mspState = (c == '<') ? MSP_FLAG : MSP_IDLE;
+            mspCrc = 0;
+            break;
+
+        case MSP_FLAG:
+            mspState = MSP_CMD_LO;
+            break;
+
+        case MSP_CMD_LO:
+            mspCmd = c;
+            mspState = MSP_CMD_HI;
+            break;
+
+        case MSP_CMD_HI:
+            mspCmd |= c << 8;
+            mspState = MSP_SIZE_LO;
+            break;
+
+        case MSP_SIZE_LO:
+            mspSize = c;
+            mspState = MSP_SIZE_HI;
+            break;
+
+        case MSP_SIZE_HI:
+            mspSize |= c << 8;
+            mspOffset = 0;
+
+            if (mspSize > MSP_RX_PAYLOAD_MAX) {
+                mspState = MSP_IDLE;
+            } else {
+                mspState = mspSize ? MSP_PAYLOAD : MSP_CHECKSUM;
+            }
+
+            break;
+
+        case MSP_PAYLOAD:
+            mspIn[mspOffset++] = c;
+
+            if (mspOffset == mspSize) {
+                mspState = MSP_CHECKSUM;
+            }
+
+            break;
+
+        case MSP_CHECKSUM:
+            if (c == mspCrc) {
+                mspHandle();
+            }
+
+            mspState = MSP_IDLE;
+            break;
+        }
+    }
+}
+
+
+// Queue one telemetry frame, or nothing if the TX buffer can't take all of it
+bool mspSendTelemetry(void)
+{
+    uint8_t* p = mspFrame;
+    uint8_t crc = 0;
+    uint8_t i;
+
+    if (serial_tx_free() < sizeof(mspFrame)) {
+        return false;
+    }
+
+    *p++ = '$';
+    *p++ = 'X';
+    *p++ = '>';
+    *p++ = 0;
+    p = mspPut16(p, MSP2_CX10_TELEMETRY);
+    p = mspPut16(p, MSP_TELEMETRY_SIZE);
+
+    for (i = 0; i < 6; i++) {
+        p = mspPut16(p, RXcommands[i]);
+    }
+
+    p = mspPut16(p, LiPoVolt);
+
+    for (i = 0; i < 3; i++) {
+        p = mspPut16(p, GyroXYZ[i]);
+    }
+
+    for (i = 0; i < 3; i++) {
+        p = mspPut16(p, ACCXYZ[i]);
+    }
+
+    *p++ = Armed;
+    *p++ = battery.soc;
+    *p++ = idleSleepPct;
+    p = mspPut16(p, cycleStartLate);
+
+    // CRC covers flag through payload
+    for (i = 3; i < p - mspFrame; i++) {
+        crc = mspCrc8(crc, mspFrame[i]);
+    }
+
+    *p = crc;
+
+    serial_send_bytes(mspFrame, sizeof(mspFrame));
+    return true;
+}
+
+#endif
@@ -0,0 +1,37 @@
+
+// MSP v2 framing: '$' 'X' '>' flag cmd(2) size(2) payload crc8(DVB-S2)
+#define MSP2_CX10_TELEMETRY  0x4358   // 'C' 'X', unsolicited status frame
+
+// MSP2_CX10_TELEMETRY payload, little endian:
+//   int16 RXcommands[6], int16 LiPoVolt, int16 GyroXYZ[3],
+//   int16 ACCXYZ[3], uint8 Armed, uint8 battery state of charge (percent),
+//   uint8 idleSleepPct, uint16 cycleStartLate (us, over the last 256 cycles)
+#define MSP_TELEMETRY_SIZE   31
+#define MSP_FRAME_OVERHEAD   9
+
+// Host requests, '$' 'X' '<' frames. Replies echo the command with '>',
+// or '!' with no payload if the command is unknown or the payload wrong.
+#define MSP_PID              112      // uint8 P, I, D for roll, pitch, yaw
+#define MSP_SET_PID          202      // same payload, refused while armed
+#define MSP2_CX10_RATES      0x4359   // uint16 RC_Rate, uint8 RPY_Rate[3]
+#define MSP2_CX10_SET_RATES  0x435A   // same payload, refused while armed
+#define MSP2_CX10_FLIGHTREC  0x435B   // unsolicited, see flightrec.h
+#define MSP2_CX10_PROFILE    0x435C   // request uint8 stage, reply uint8 stage,
+                                      // uint32 count, min, mean, max (cycles),
+                                      // uint16 log2 histogram[16]; resets the stage
+#define MSP2_CX10_TRACE      0x435D   // unsolicited, see trace.h
+#define MSP2_CX10_HOP        0x435E   // RF_HOPPING, per hop slot: uint8 channel,
+                                      // uint16 received, missed (since power up)
+#define MSP2_CX10_LINK       0x435F   // RF, last second (see nrf24RX.h): uint16 received,
+                                      // expected, rejected, rpdHits, gapMin, gapAvg, gapMax,
+                                      // spi, polls, pollMisses
+#define MSP2_CX10_LATENCY    0x4360   // uint16 RX to PWM latency histogram[16] (250us
+                                      // buckets, since power up), uint16 RX period (us,
+                                      // LOOP_PHASE_LOCK only, 0 if not measured)
+#define MSP2_CX10_BLACKBOX   0x4361   // unsolicited, see blackbox.h
+#define MSP_RX_PAYLOAD_MAX   32
+#define MSP_TX_PAYLOAD_MAX   64
+
+bool mspSendTelemetry(void);
+void mspProcessInput(void);
+bool mspSendFrame(uint16_t cmd, uint8_t* payload, uint8_t size);
@@ -34,22 +34,124 @@
 #include "config.h"
 
 #define RF_CHANNEL      0x3C      // Stock TX fixed frequency
-#define PAYLOADSIZE       9          // Protocol packet size
+#define PAYLOADSIZE       RF_FRAME_SIZE // Protocol packet size
+
+// Learned bind, kept in the last 1K flash page (reserved in the linker script)
+#define BIND_RECORD_ADDR  0x08007C00
+#define BIND_RECORD_MAGIC 0xB1
+#define RECONNECT_TIME    500        // ms on the stored address before binding
+
+#if !defined(RADIO_GPIO_IRQ)
+#define POLL_SPARSE       8          // Poll every n-th cycle outside the window (rflink.h)
+#endif
+
+#if defined(RF_HOPPING)
+#define HOP_CHANNELS      8          // Length of the hop sequence
+#define HOP_FIRST         0x02       // Lowest channel used, 2402MHz
+#define HOP_SPAN          0x4F       // Channels available from HOP_FIRST
+#define HOP_PERIOD        20000      // us between packets (and hops) from the TX
+#define HOP_MARGIN        4000       // us late before a slot counts as missed
+#define HOP_LOST          (2 * HOP_CHANNELS) // Missed slots before resync
+#define HOP_DWELL         ((HOP_CHANNELS + 1) * HOP_PERIOD) // Resync dwell
+#endif
 
-extern uint8_t failsave;
 bool bind = false;
 extern int16_t RXcommands[6];
 
 char rxbuffer[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
 const char rf_addr_bind[5] = {0x65, 0x65, 0x65, 0x65, 0x65};
 static char rf_addr_cmnd[5];
+static uint8_t rf_channel = RF_CHANNEL;
 
 bool flashstate = false;
 uint32_t flashtime;
 
-// Configure the nrf24/Beken 2423 and bind
+// Single-slot mailbox between the radio interrupt and the control loop.
+// The ISR is the only writer and bumps the sequence on either side of the
+// copy, the loop retries its copy if the sequence moved underneath it.
+static seqlock_t rxMailSeq = 0;
+static uint8_t rxMailTaken = 0;
+static char rxMail[PAYLOADSIZE];
+
+// Bind progress, see bind_RFRX()
+typedef enum {
+    BIND_RECONNECT,     // Listening on the stored command address
+    BIND_LISTEN,        // Waiting for a packet on the bind address
+    BIND_CONFIRM,       // Waiting for the first packet on the command address
+    BIND_DONE
+} bindState_t;
+
+static bindState_t bindState = BIND_LISTEN;
+static uint32_t bindStart;
+
+typedef struct {
+    uint8_t magic;
+    uint8_t channel;
+    char addr[5];
+    uint8_t spare;
+    uint16_t crc;
+} bindRecord_t;
+
+#if defined(RF_HOPPING)
+// Per channel packet counts, loss rate is missed / (received + missed),
+// read with MSP2_CX10_HOP (rfHopReport)
+static uint16_t hopReceived[HOP_CHANNELS];
+static uint16_t hopMissed[HOP_CHANNELS];
+
+static uint8_t hopTable[HOP_CHANNELS];
+static volatile uint8_t hopIndex;
+static volatile uint8_t hopLost;
+static volatile uint32_t hopSlot;       // Start of the current slot
+
+static void rfHopTable(void);
+static void rfHopStart(void);
+static void rfHopTick(void);
+#endif
+
+// Link statistics, rfLinkStats is the last complete second
+rfLinkStats_t rfLinkStats;
+static rfLinkStats_t linkAcc = {0, 0, 0, 0, 0xFFFF, 0, 0, 0, 0, 0};
+static rfLink_t link = RF_LINK_INIT;
+static uint32_t linkSecond;
+static uint32_t linkSpi;
+#if !defined(RADIO_GPIO_IRQ)
+static uint32_t pollLast;       // Previous status poll, later packets arrived after it
+#endif
+
+#if defined(RF_TELEMETRY)
+static uint8_t tlmType;
+static uint8_t tlmSeq;
+
+static void rfTelemetryPreload(void);
+#endif
+
+// Frames refused before reaching RXcommands[], totals since power up
+uint16_t rfRejectLength;
+uint16_t rfRejectChecksum;
+
+static void rfRxIsr(void);
+static void rfBindDone(void);
+static void rfLinkAccount(uint32_t now, int count);
+static void rfLinkTick(void);
+static bool rfMailboxTake(char* buffer);
+static void rfBindFlasher(uint32_t rate);
+static void rfSetAddress(const char* addr, uint8_t channel);
+static bool rfLoadBind(void);
+static void rfSaveBind(void);
+
+// Configure the nrf24/Beken 2423 and start listening for a bind packet
 void init_RFRX()
 {
+    // Previously bound TX, if any
+    bool stored = rfLoadBind();
+
+#if defined(RF_HOPPING)
+    // A hopping TX passes the first channel of its sequence every cycle
+    if (stored) {
+        rfHopTable();
+        rf_channel = hopTable[0];
+    }
+#endif
 
     // Initialise SPI, clocks, etc.
     nrfInit();
@@ -63,7 +165,7 @@ void init_RFRX()
     nrfWrite1Reg(REG_SETUP_AW, NRF24_AW_5_BYTES);    // 5-byte TX/RX adddress
 
     nrfWrite1Reg(REG_SETUP_RETR, 0x1A);              // 500uS timeout, 10 retries
-    nrfWrite1Reg(REG_RF_CH, RF_CHANNEL);            // Channel 0x3C
+    nrfWrite1Reg(REG_RF_CH, rf_channel);            // Channel 0x3C
     nrfWrite1Reg(REG_RF_SETUP, NRF24_PWR_0dBm);       // 1Mbps, 0dBm
     nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);       // Clear status
 
@@ -120,38 +222,63 @@ void init_RFRX()
     nrfFlushRx();
     nrfFlushTx();
 
-    // Set device to bind address
-    nrfWriteReg(REG_RX_ADDR_P0, (char*) rf_addr_bind, 5);
-    nrfWriteReg(REG_TX_ADDR, (char*) rf_addr_bind, 5);
+    // Try the previously bound TX first, otherwise go straight to binding
+    if (stored) {
+        nrfWriteReg(REG_RX_ADDR_P0, rf_addr_cmnd, 5);
+        nrfWriteReg(REG_TX_ADDR, rf_addr_cmnd, 5);
+        bindState = BIND_RECONNECT;
+    } else {
+        nrfWriteReg(REG_RX_ADDR_P0, (char*) rf_addr_bind, 5);
+        nrfWriteReg(REG_TX_ADDR, (char*) rf_addr_bind, 5);
+        bindState = BIND_LISTEN;
+    }
 
-    // Power up
-    nrfWrite1Reg(REG_CONFIG, (NRF24_EN_CRC | NRF24_PWR_UP | NRF24_PRIM_RX));
+    // Power up, the radio interrupt only signals received packets
+    nrfWrite1Reg(REG_CONFIG, (NRF24_MASK_TX_DS | NRF24_MASK_MAX_RT |
+                              NRF24_EN_CRC | NRF24_PWR_UP | NRF24_PRIM_RX));
 
-    while (!bind) {
+    // Packets are read from the radio interrupt, binding is then
+    // completed by bind_RFRX() from the main loop
+    nrfSetInterruptCallback(rfRxIsr);
+    nrfSetInterruptEnable(true);
 
-        // Wait until we receive a data packet, flashing alternately
-        flashtime = micros() / 1000;
+    flashtime = micros() / 1000;
+    bindStart = flashtime;
+}
 
-        while (!(nrfGetStatus() & 0x40)) {
-            bindflasher(500);
-        }
 
+// Advance the bind state machine, called every cycle until bound
+void bind_RFRX()
+{
+    switch (bindState) {
+
+    case BIND_RECONNECT:
+
+        // A packet on the stored address means the TX is already bound
+        if (rxMailSeq != rxMailTaken) {
+            rfBindDone();
+            break;
+        }
 
-        // TX sends mutliple packets, so keep reading the FIFO
-        // until there is no more data.
-        while (!(nrfRead1Reg(REG_FIFO_STATUS) & 0x01)) {
+        rfBindFlasher(250);
 
-            // Bind packet is nine bytes on pipe zero
-            if (nrfRxLength(0) == PAYLOADSIZE) {
+        if (micros() / 1000 - bindStart > RECONNECT_TIME) {
+            rf_channel = RF_CHANNEL;
+            rfSetAddress(rf_addr_bind, rf_channel);
 
-                // Get the packet
-                nrfReadRX(rxbuffer, PAYLOADSIZE);
-            }
+            flashtime = micros() / 1000;
+            bindState = BIND_LISTEN;
         }
 
-        // Flush buffer and clear status
-        nrfFlushRx();
-        nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);
+        break;
+
+    case BIND_LISTEN:
+
+        // The TX sends multiple bind packets, the mailbox keeps the newest
+        if (!rfMailboxTake(rxbuffer)) {
+            rfBindFlasher(500);
+            break;
+        }
 
         // Configure the command address
         rf_addr_cmnd[0] = rxbuffer[0];
@@ -161,71 +288,468 @@ void init_RFRX()
         rf_addr_cmnd[4] = 0xC1;
 
         // Set to TX command address
-        nrfWriteReg(REG_RX_ADDR_P0,  rf_addr_cmnd, 5);
-        nrfWriteReg(REG_TX_ADDR, rf_addr_cmnd, 5);
-
-        // Flush buffer and clear status
-        nrfFlushRx();
-        nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);
+        rfSetAddress(rf_addr_cmnd, rf_channel);
 
-        // Wait until we receive data on the command address
         flashtime = micros() / 1000;
+        bindState = BIND_CONFIRM;
+        break;
 
-        while (!(nrfGetStatus() & 0x40)) {
-            bindflasher(250);
+    case BIND_CONFIRM:
+
+        // Wait until we receive data on the command address, the packet
+        // itself is left in the mailbox for get_RFRXDatas()
+        if (rxMailSeq == rxMailTaken) {
+            rfBindFlasher(250);
+            break;
         }
 
-        bind = true;
+        // Remember the TX for the next power cycle
+        rfSaveBind();
+
+        rfBindDone();
+        break;
+
+    case BIND_DONE:
+        break;
+    }
+}
+
+
+
+// Bound to a TX, hand over to get_RFRXDatas()
+static void rfBindDone(void)
+{
+#if defined(RF_HOPPING)
+    // Before bind is set, the radio interrupt only hops once bound
+    rfHopStart();
+#endif
+
+    bind = true;
+    bindState = BIND_DONE;
+
+    // Turn of LEDs
+    GPIO_WriteBit(LED1_PORT, LED1_BIT, LEDoff);
+    GPIO_WriteBit(LED2_PORT, LED2_BIT, LEDoff);
+}
+
+
+// Switch the RX/TX address, dropping anything received on the old one
+static void rfSetAddress(const char* addr, uint8_t channel)
+{
+    // Keep the radio interrupt off the bus while it is reprogrammed
+    nrfSetInterruptEnable(false);
+
+    nrfSetChannel(channel);
+    nrfWriteReg(REG_RX_ADDR_P0, (char*) addr, 5);
+    nrfWriteReg(REG_TX_ADDR, (char*) addr, 5);
+
+    // Flush buffer and clear status
+    nrfFlushRx();
+    nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);
+
+    // Drop any packet that was delivered in the meantime
+    rfMailboxTake(rxbuffer);
+
+    nrfSetInterruptEnable(true);
+}
 
-        // Turn of LEDs
-        GPIO_WriteBit(LED1_PORT, LED1_BIT, LEDoff);
-        GPIO_WriteBit(LED2_PORT, LED2_BIT, LEDoff);
 
+// CRC-16/CCITT over the bind record
+static uint16_t rfCrc16(const uint8_t* data, int len)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
     }
 
+    return crc;
 }
 
 
+// Fetch the stored command address, false if there is no valid record
+static bool rfLoadBind(void)
+{
+    const bindRecord_t* record = (const bindRecord_t*) BIND_RECORD_ADDR;
+
+    if (record->magic != BIND_RECORD_MAGIC ||
+        record->crc != rfCrc16((const uint8_t*) record, sizeof(bindRecord_t) - 2)) {
+        return false;
+    }
+
+    memcpy(rf_addr_cmnd, record->addr, 5);
+    rf_channel = record->channel;
+
+    return true;
+}
+
+
+// Store the command address, the page is only rewritten if it changed
+static void rfSaveBind(void)
+{
+    bindRecord_t record;
+    const uint16_t* data = (const uint16_t*) &record;
+    uint8_t i;
+
+    memset(&record, 0, sizeof(record));
+    record.magic = BIND_RECORD_MAGIC;
+    record.channel = rf_channel;
+    memcpy(record.addr, rf_addr_cmnd, 5);
+    record.crc = rfCrc16((const uint8_t*) &record, sizeof(bindRecord_t) - 2);
+
+    if (memcmp((const void*) BIND_RECORD_ADDR, &record, sizeof(record)) == 0) {
+        return;
+    }
+
+    FLASH_Unlock();
+
+    // A flag left over from an earlier failed attempt would fail this one
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPERR);
+
+    if (FLASH_ErasePage(BIND_RECORD_ADDR) == FLASH_COMPLETE) {
+        for (i = 0; i < sizeof(record) / 2; i++) {
+            FLASH_ProgramHalfWord(BIND_RECORD_ADDR + 2 * i, data[i]);
+        }
+    }
+
+    FLASH_Lock();
+}
+
+
+// Radio IRQ callback, move the packet into the mailbox
+static void rfRxIsr(void)
+{
+    uint8_t i;
+    char packet[PAYLOADSIZE];
+    int count;
+    int dropped = 0;
+    uint32_t now;
+
+    // Drain the FIFO, keep the newest command and clear the interrupt
+    count = nrfReceive(packet, PAYLOADSIZE, &dropped);
+
+    if (dropped) {
+        rfRejectLength += dropped;
+        linkAcc.rejected += dropped;
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    if (!rfValidFrame(packet)) {
+        rfRejectChecksum++;
+        linkAcc.rejected++;
+        return;
+    }
+
+    now = micros();
+
+    if (bind) {
+        RXlastUpdate = now;
+        rfLinkAccount(now, count);
+    }
+
+#if defined(RF_HOPPING)
+    // Follow the TX to its next channel straight away
+    if (bind) {
+        hopReceived[hopIndex]++;
+        hopLost = 0;
+        hopSlot = now;
+
+        hopIndex = (hopIndex + 1) % HOP_CHANNELS;
+        nrfSetChannel(hopTable[hopIndex]);
+    }
+#endif
+
+#if defined(RF_TELEMETRY)
+    if (bind) {
+        rfTelemetryPreload();
+    }
+#endif
+
+    seqWriteBegin(&rxMailSeq);
+
+    for (i = 0; i < PAYLOADSIZE; i++) {
+        rxMail[i] = packet[i];
+    }
+
+    seqWriteEnd(&rxMailSeq);
+}
+
+// Copy the newest packet out of the mailbox, returns false if already taken
+static bool rfMailboxTake(char* buffer)
+{
+    uint8_t i;
+    uint8_t seq;
+
+    do {
+        seq = seqReadBegin(&rxMailSeq);
+
+        for (i = 0; i < PAYLOADSIZE; i++) {
+            buffer[i] = rxMail[i];
+        }
+    } while (seqReadRetry(&rxMailSeq, seq));
+
+    if (seq == rxMailTaken) {
+        return false;
+    }
+
+    rxMailTaken = seq;
+    return true;
+}
+
+// Account a received packet, runs in the radio interrupt or the poll.
+// RPD is the carrier detect latched for this packet.
+static void rfLinkAccount(uint32_t now, int count)
+{
+#if defined(RADIO_GPIO_IRQ)
+    rfLinkPacket(&link, &linkAcc, now, now, count);
+#else
+    rfLinkPacket(&link, &linkAcc, pollLast, now, count);
+#endif
+
+    if (nrfRead1Reg(REG_RPD) & 0x01) {
+        linkAcc.rpdHits++;
+    }
+}
+
+
+// Publish the statistics once a second
+static void rfLinkTick(void)
+{
+    uint32_t now = micros();
+
+    if (now - linkSecond < 1000000) {
+        return;
+    }
+
+    linkSecond = now;
+
+    nrfSetInterruptEnable(false);
+
+    linkAcc.gapAvg = link.gaps ? link.gapSum / link.gaps : 0;
+    linkAcc.spi = nrfTransactions() - linkSpi;
+    linkSpi += linkAcc.spi;
+    rfLinkStats = linkAcc;
+
+    memset(&linkAcc, 0, sizeof(linkAcc));
+    linkAcc.gapMin = 0xFFFF;
+    link.gapSum = 0;
+    link.gaps = 0;
+
+    nrfSetInterruptEnable(true);
+}
+
+
+// Last second's statistics for MSP2_CX10_LINK, returns the size
+uint8_t rfLinkReport(uint8_t* out)
+{
+    const uint16_t* field = &rfLinkStats.received;
+    uint8_t* p = out;
+    uint8_t i;
+
+    // received through pollMisses
+    for (i = 0; i < sizeof(rfLinkStats) / 2; i++) {
+        *p++ = field[i];
+        *p++ = field[i] >> 8;
+    }
+
+    return p - out;
+}
+
+
+#if defined(RF_TELEMETRY)
+// Downlink scheduler, runs in the radio interrupt after a packet has been
+// read. The next frame type in the rotation goes into the ACK payload of
+// the next packet, only one frame is queued so the data is at most one
+// packet old. Frame layout is described in rfframe.h.
+static void rfTelemetryPreload(void)
+{
+    char frame[TLM_FRAME_MAX];
+    rfTlm_t tlm;
+    int len;
+
+    // Previous frame has not gone out yet
+    if (!(nrfRead1Reg(REG_FIFO_STATUS) & NRF24_TX_EMPTY)) {
+        return;
+    }
+
+    tlm.lipoVolt = LiPoVolt;
+    tlm.armed = Armed;
+    tlm.soc = battery.soc;
+    tlm.received = rfLinkStats.received;
+    tlm.expected = rfLinkStats.expected;
+    tlm.rejected = rfLinkStats.rejected;
+    tlm.rpdHits = rfLinkStats.rpdHits;
+    tlm.loopOverruns = loopOverruns;
+    tlm.i2cErrors = I2C_Errors;
+
+    len = rfTlmEncode(frame, tlmType, tlmSeq++, &tlm);
+
+    tlmType = (tlmType + 1) % TLM_TYPES;
+
+    nrfWriteAck(0, frame, len);
+}
+#endif
+
+
+// Called every cycle. With the radio IRQ wired (RF_IRQ) packets are read on
+// arrival and there is nothing to do. Without it, the default, the status
+// is polled every cycle in a window around the arrival predicted from the
+// learned packet period and phase (rfLinkWindow), and only every
+// POLL_SPARSE cycles outside it (or while no packets are arriving). The
+// previous poll bounds the arrival of a packet a poll finds, so the
+// prediction follows the arrival rather than the poll that caught it.
+// Packets caught by a sparse poll count as misses of the window. Polls,
+// misses and SPI traffic are in rfLinkStats, read with MSP2_CX10_LINK.
+void poll_RFRX()
+{
+#if !defined(RADIO_GPIO_IRQ)
+    static uint8_t sparse = 0;
+    uint32_t now = micros();
+    bool window = rfLinkWindow(&link, now);
+
+    if (!window && ++sparse < POLL_SPARSE) {
+        return;
+    }
+
+    sparse = 0;
+    linkAcc.polls++;
+
+    if (nrfGetStatus() & 0x40) {
+        if (!window && bind) {
+            linkAcc.pollMisses++;
+        }
+
+        rfRxIsr();
+    }
+
+    pollLast = now;
+#endif
+}
+
 
 // Place RF command data in RXcommand variable, process AUX commands
 void get_RFRXDatas()
 {
 
-    // If a new packet exists in the buffer
-    if (nrfGetStatus() & 0x40) {
-        // Read the latest command to the buffer
-        nrfReadRX(rxbuffer, PAYLOADSIZE);
-
-        // Flush the buffer and clear interrupt
-        nrfFlushRx();
-        nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);
-
-        // FC order: T   A   E   R   A1   A2
-        // RF order: T    R   ?   E   A     Et    At   F   ?
-
-        // PPM firmware expects a range of 1000, TX range is 0xFF (max rate), mid-stick is 0x40,
-        // BS twice leads to a range of 1020, which is close enough for now.
-        RXcommands[0] = constrain((((int16_t)rxbuffer[0]) << 2), 0, 1000);
-        RXcommands[1] = constrain((((int16_t)rxbuffer[4]) << 2) - 512, -500, 500);
-        RXcommands[2] = constrain((((int16_t)rxbuffer[3]) << 2) - 512, -500, 500);
-        RXcommands[3] = constrain((((int16_t)rxbuffer[1]) << 2) - 512, -500, 500);
-
-        // Forward flip sets AUX1 high, backwards flip sets AUX1 low
-        if (rxbuffer[7] & 0x0F) {
-            if ((uint8_t) rxbuffer[3] > 0xF0) {
-                RXcommands[4] = 500;
-            }
-
-            if ((uint8_t) rxbuffer[3] < 0x0F) {
-                RXcommands[4] = -500;
-            }
+    // Until bound the mailbox belongs to bind_RFRX()
+    if (!bind) {
+        return;
+    }
+
+#if defined(RF_HOPPING)
+    rfHopTick();
+#endif
+
+    rfLinkTick();
+
+    // If a new packet has been delivered by the radio interrupt
+    // (only frames that passed rfValidFrame() get there)
+    if (rfMailboxTake(rxbuffer)) {
+        rfFrameCommands(rxbuffer, RXcommands);
+    }
+
+}
+
+
+// Bind LED pattern, left to the gyro calibration while that is running
+static void rfBindFlasher(uint32_t rate)
+{
+    if (calibGyroDone == 0) {
+        bindflasher(rate);
+    }
+}
+
+#if defined(RF_HOPPING)
+// Derive the hop sequence from the TX ID
+static void rfHopTable(void)
+{
+    uint32_t seed = ((uint32_t) rf_addr_cmnd[0] << 24) | ((uint32_t) rf_addr_cmnd[1] << 16) |
+                    ((uint32_t) rf_addr_cmnd[2] << 8) | (uint8_t) rf_addr_cmnd[3];
+    uint8_t i, j;
+
+    for (i = 0; i < HOP_CHANNELS; i++) {
+        do {
+            seed = seed * 1103515245 + 12345;
+            hopTable[i] = HOP_FIRST + (seed >> 16) % HOP_SPAN;
+
+            for (j = 0; j < i && hopTable[j] != hopTable[i]; j++);
+        } while (j < i);
+    }
+}
+
+
+// Start hopping with a resync search
+static void rfHopStart(void)
+{
+    rfHopTable();
+
+    nrfSetInterruptEnable(false);
+
+    hopIndex = 0;
+    hopLost = HOP_LOST;
+    hopSlot = micros();
+    nrfSetChannel(hopTable[0]);
+
+    nrfSetInterruptEnable(true);
+}
+
+
+// Hop on a missed slot. Once too many slots in a row are missed the link
+// counts as lost and the RX parks on each channel long enough for the TX
+// to pass through it, the next packet then locks the sequence again.
+static void rfHopTick(void)
+{
+    uint32_t timeout = (hopLost >= HOP_LOST) ? HOP_DWELL : HOP_PERIOD + HOP_MARGIN;
+
+    if (micros() - hopSlot < timeout) {
+        return;
+    }
+
+    nrfSetInterruptEnable(false);
+
+    // Recheck now the radio interrupt cannot move the slot
+    if (micros() - hopSlot >= timeout) {
+        if (hopLost < HOP_LOST) {
+            hopMissed[hopIndex]++;
+            hopLost++;
         }
 
-        // Since data has been received, reset failsafe counter
-        failsave = 0;
+        // Keep the predicted phase while tracking, restart it when searching
+        hopSlot = (hopLost >= HOP_LOST) ? micros() : hopSlot + HOP_PERIOD;
+
+        hopIndex = (hopIndex + 1) % HOP_CHANNELS;
+        nrfSetChannel(hopTable[hopIndex]);
+    }
+
+    nrfSetInterruptEnable(true);
+}
+
+
+// Per channel counts since power up for MSP2_CX10_HOP, returns the size
+uint8_t rfHopReport(uint8_t* out)
+{
+    uint8_t* p = out;
+    uint8_t i;
+
+    for (i = 0; i < HOP_CHANNELS; i++) {
+        *p++ = hopTable[i];
+        *p++ = hopReceived[i];
+        *p++ = hopReceived[i] >> 8;
+        *p++ = hopMissed[i];
+        *p++ = hopMissed[i] >> 8;
     }
 
+    return p - out;
 }
+#endif
 
 
 void bindflasher(uint32_t rate)
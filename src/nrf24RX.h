@@ -1,5 +1,23 @@
+#ifndef __NRF24RX_H__
+#define __NRF24RX_H__
+
+#include "rflink.h"
+
+// Radio link health over the last second (rfLinkStats_t in rflink.h)
+extern rfLinkStats_t rfLinkStats;
+extern uint16_t rfRejectLength;
+extern uint16_t rfRejectChecksum;
+
 
 
 void init_RFRX(void);
+void poll_RFRX(void);
+void bind_RFRX(void);
 void get_RFRXDatas(void);
 void bindflasher(uint32_t rate);
+uint8_t rfLinkReport(uint8_t* out);
+#if defined(RF_HOPPING)
+uint8_t rfHopReport(uint8_t* out);
+#endif
+
+#endif
@@ -75,6 +75,17 @@
 static bool isInit;
 static void (*interruptCb)(void) = NULL;
 
+/* Burst transfer state, one command byte plus up to a 32 byte payload */
+#define BURST_MAX 33
+
+static char burstTx[BURST_MAX];
+static char burstRx[BURST_MAX];
+static char* burstDest;
+static int burstLen;
+static unsigned char burstStatus;
+static volatile bool burstBusy;
+static uint32_t transactions;
+
 /***********************
  * SPI private methods *
  ***********************/
@@ -93,57 +104,172 @@ static char spiSendByte(char byte)
     return SPI_ReceiveData8(RADIO_SPI);
 }
 
-static char spiReceiveByte()
+/* Take the bus for one transaction. Test and set run with interrupts
+ * masked, so the radio interrupt can't claim it between them.
+ * Released by the polled path once CS is up, by spiBurstFinish() for a burst.
+ */
+static bool spiTryClaim(void)
 {
-    return spiSendByte(DUMMY_BYTE);
+    uint32_t primask = __get_PRIMASK();
+    bool claimed = false;
+
+    __disable_irq();
+
+    if (!burstBusy) {
+        burstBusy = true;
+        claimed = true;
+    }
+
+    __set_PRIMASK(primask);
+
+    return claimed;
 }
 
-/****************************************************************
- * nRF SPI commands, Every commands return the status byte      *
- ****************************************************************/
+/*************************************************************
+ * SPI burst methods, SPI1_RX on DMA1 ch2, SPI1_TX on ch3    *
+ *************************************************************/
 
-/* Read len bytes from a nRF24L register. 5 Bytes max */
-unsigned char nrfReadReg(unsigned char address, char* buffer, int len)
+/* Frame the command and data, then hand the transfer to the DMA. The bus
+ * must have been claimed.
+ */
+static void spiBurstStart(unsigned char cmd, char* tx, char* rx, int len)
 {
-    unsigned char status;
     int i;
 
-    RADIO_EN_CS();
+    burstDest = rx;
+    burstLen = len;
 
-    /* Send the read command with the address */
-    status = spiSendByte(CMD_R_REG | (address & 0x1F));
+    burstTx[0] = cmd;
 
-    /* Read LEN bytes */
     for (i = 0; i < len; i++) {
-        buffer[i] = spiReceiveByte();
+        burstTx[i + 1] = tx ? tx[i] : DUMMY_BYTE;
     }
 
+    RADIO_EN_CS();
+
+    DMA1_Channel2->CNDTR = len + 1;
+    DMA1_Channel3->CNDTR = len + 1;
+
+    /* RX request and channel first so no received byte can be missed */
+    RADIO_SPI->CR2 |= SPI_CR2_RXDMAEN;
+    DMA1_Channel2->CCR |= DMA_CCR_EN;
+    DMA1_Channel3->CCR |= DMA_CCR_EN;
+    RADIO_SPI->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+/* Called once the last byte has been received */
+static void spiBurstFinish(void)
+{
+    int i;
+
+    DMA1->IFCR = DMA1_FLAG_GL2 | DMA1_FLAG_GL3;
+    DMA1_Channel2->CCR &= ~DMA_CCR_EN;
+    DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+    RADIO_SPI->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+
     RADIO_DIS_CS();
 
-    return status;
+    burstStatus = burstRx[0];
+
+    if (burstDest) {
+        for (i = 0; i < burstLen; i++) {
+            burstDest[i] = burstRx[i + 1];
+        }
+    }
+
+    burstBusy = false;
 }
 
-/* Write len bytes a nRF24L register. 5 Bytes max */
-unsigned char nrfWriteReg(unsigned char address, char* buffer, int len)
+void DMA1_Channel2_3_IRQHandler(void)
+{
+    TRACE_BEGIN(TR_SPI_DMA);
+
+    if (DMA1->ISR & DMA1_FLAG_TC2) {
+        spiBurstFinish();
+    }
+
+    TRACE_END(TR_SPI_DMA);
+}
+
+/* Send a command followed by len bytes of tx (or dummy bytes if NULL), the
+ * len bytes clocked back are stored in rx (if not NULL). Synchronous: short
+ * transfers are clocked out polled, anything longer goes on the DMA and the
+ * caller waits for its completion interrupt instead of on every byte.
+ * The radio interrupt preempting a claimed transaction would wait on it
+ * forever, so thread code holds the radio IRQ masked while it has the bus,
+ * whether or not the caller already masked it (see nrfSetInterruptEnable).
+ */
+static unsigned char spiCommand(unsigned char cmd, char* tx, char* rx, int len)
 {
     unsigned char status;
-    int i;
+#if defined(RADIO_GPIO_IRQ)
+    bool unmask = __get_IPSR() == 0 && (NVIC->ISER[0] & (1 << RADIO_EXTI_IRQn));
 
-    RADIO_EN_CS();
+    if (unmask) {
+        NVIC_DisableIRQ(RADIO_EXTI_IRQn);
+    }
+#endif
 
-    /* Send the write command with the address */
-    status = spiSendByte(CMD_W_REG | (address & 0x1F));
+    transactions++;
 
-    /* Write LEN bytes */
-    for (i = 0; i < len; i++) {
-        spiSendByte(buffer[i]);
+    while (!spiTryClaim());
+
+    if (len > 1) {
+        spiBurstStart(cmd, tx, rx, len);
+
+        while (burstBusy);
+
+        status = burstStatus;
+    } else {
+        RADIO_EN_CS();
+
+        status = spiSendByte(cmd);
+
+        if (len == 1) {
+            char byte = spiSendByte(tx ? tx[0] : DUMMY_BYTE);
+
+            if (rx) {
+                rx[0] = byte;
+            }
+        }
+
+        RADIO_DIS_CS();
+
+        burstBusy = false;
     }
 
-    RADIO_DIS_CS();
+#if defined(RADIO_GPIO_IRQ)
+    // An edge while masked stays pending in the NVIC
+    if (unmask) {
+        NVIC_EnableIRQ(RADIO_EXTI_IRQn);
+    }
+#endif
 
     return status;
 }
 
+/* Chip-select transactions issued since power up */
+uint32_t nrfTransactions(void)
+{
+    return transactions;
+}
+
+/****************************************************************
+ * nRF SPI commands, Every commands return the status byte      *
+ ****************************************************************/
+
+/* Read len bytes from a nRF24L register. 5 Bytes max */
+unsigned char nrfReadReg(unsigned char address, char* buffer, int len)
+{
+    return spiCommand(CMD_R_REG | (address & 0x1F), NULL, buffer, len);
+}
+
+/* Write len bytes a nRF24L register. 5 Bytes max */
+unsigned char nrfWriteReg(unsigned char address, char* buffer, int len)
+{
+    return spiCommand(CMD_W_REG | (address & 0x1F), buffer, NULL, len);
+}
+
 /* Write only one byte (useful for most of the reg.) */
 unsigned char nrfWrite1Reg(unsigned char address, char byte)
 {
@@ -163,116 +289,107 @@ unsigned char nrfRead1Reg(unsigned char address)
 /* Sent the NOP command. Used to get the status byte */
 unsigned char nrfNop()
 {
-    unsigned char status;
-
-    RADIO_EN_CS();
-    status = spiSendByte(CMD_NOP);
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_NOP, NULL, NULL, 0);
 }
 
 unsigned char nrfFlushRx()
 {
-    unsigned char status;
-
-    RADIO_EN_CS();
-    status = spiSendByte(CMD_FLUSH_RX);
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_FLUSH_RX, NULL, NULL, 0);
 }
 
 unsigned char nrfFlushTx()
 {
-    unsigned char status;
-
-    RADIO_EN_CS();
-    status = spiSendByte(CMD_FLUSH_TX);
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_FLUSH_TX, NULL, NULL, 0);
 }
 
 // Return the payload length
 unsigned char nrfRxLength(unsigned int pipe)
 {
-    unsigned char length;
+    char length;
 
-    RADIO_EN_CS();
-    spiSendByte(CMD_RX_PL_WID);
-    length = spiReceiveByte();
-    RADIO_DIS_CS();
+    spiCommand(CMD_RX_PL_WID, NULL, &length, 1);
 
     return length;
 }
 
 unsigned char nrfActivate()
 {
-    unsigned char status;
+    char data = ACTIVATE_DATA;
 
-    RADIO_EN_CS();
-    status = spiSendByte(CMD_ACTIVATE);
-    spiSendByte(ACTIVATE_DATA);
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_ACTIVATE, &data, NULL, 1);
 }
 
 unsigned char nrfActivateBK2423()
 {
-    unsigned char status;
+    char data = ACTIVATE_BK2423_DATA;
 
-    RADIO_EN_CS();
-    status = spiSendByte(CMD_ACTIVATE);
-    spiSendByte(ACTIVATE_BK2423_DATA);
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_ACTIVATE, &data, NULL, 1);
 }
 
 // Write the ack payload of the pipe 0
 unsigned char nrfWriteAck(unsigned int pipe, char* buffer, int len)
 {
-    unsigned char status;
-    int i;
-
     //ASSERT(pipe<6);
 
-    RADIO_EN_CS();
-
-    /* Send the read command with the address */
-    status = spiSendByte(CMD_W_ACK_PAYLOAD(pipe));
-
-    /* Read LEN bytes */
-    for (i = 0; i < len; i++) {
-        spiSendByte(buffer[i]);
-    }
-
-    RADIO_DIS_CS();
-
-    return status;
+    return spiCommand(CMD_W_ACK_PAYLOAD(pipe), buffer, NULL, len);
 }
 
 // Read the RX payload
 unsigned char nrfReadRX(char* buffer, int len)
 {
+    return spiCommand(CMD_R_RX_PAYLOAD, NULL, buffer, len);
+}
+
+/* Coalesced receive: drain the RX FIFO keeping only the newest packet.
+ * RX_DR is cleared first, so a packet landing during the drain raises a
+ * fresh interrupt even if the drain already took it (that one then finds
+ * the FIFO empty). The RX_P_NO field of the status byte clocked out with
+ * every command shows whether the FIFO still holds data, so no separate
+ * NOP or FIFO_STATUS read is needed: each packet's dynamic payload width
+ * read doubles as the check for a further packet.
+ * Packets that are not len bytes long are popped unseen and counted in
+ * dropped. Two transactions per packet plus two, returns the number of
+ * good packets read.
+ */
+int nrfReceive(char* buffer, int len, int* dropped)
+{
+    char packet[32];
+    char width;
     unsigned char status;
+    int count = 0;
     int i;
 
-    RADIO_EN_CS();
+    if (len > 32) {
+        return 0;
+    }
 
-    /* Send the read command with the address */
-    status = spiSendByte(CMD_R_RX_PAYLOAD);
+    nrfWrite1Reg(REG_STATUS, NRF_STATUS_CLEAR);
 
-    /* Read LEN bytes */
-    for (i = 0; i < len; i++) {
-        buffer[i] = spiReceiveByte();
-    }
+    status = spiCommand(CMD_RX_PL_WID, NULL, &width, 1);
 
-    RADIO_DIS_CS();
+    while ((status & NRF_STATUS_RX_P_NO) != NRF_STATUS_RX_EMPTY) {
+        if (width == len) {
+            nrfReadRX(packet, len);
 
-    return status;
+            for (i = 0; i < len; i++) {
+                buffer[i] = packet[i];
+            }
+
+            count++;
+        } else if ((unsigned char) width <= 32) {
+            // Wrong length, pop it without using it
+            nrfReadRX(packet, width);
+            (*dropped)++;
+        } else {
+            // Corrupt width, the datasheet asks for a flush
+            nrfFlushRx();
+            (*dropped)++;
+        }
+
+        status = spiCommand(CMD_RX_PL_WID, NULL, &width, 1);
+    }
+
+    return count;
 }
 
 /* Interrupt service routine, call the interrupt callback
@@ -291,6 +408,45 @@ void nrfSetInterruptCallback(void (*cb)(void))
     interruptCb = cb;
 }
 
+/* Unmask or mask the radio IRQ line in the NVIC. While masked, the SPI bus
+ * may be used from thread context without racing the interrupt callback.
+ */
+void nrfSetInterruptEnable(bool enable)
+{
+#if defined(RADIO_GPIO_IRQ)
+    if (enable) {
+        NVIC_EnableIRQ(RADIO_EXTI_IRQn);
+
+        // The line may already be low, in which case no edge will follow
+        if (!(RADIO_GPIO_IRQ_PORT->IDR & RADIO_GPIO_IRQ)) {
+            EXTI->SWIER = RADIO_EXTI_LINE;
+        }
+    } else {
+        NVIC_DisableIRQ(RADIO_EXTI_IRQn);
+    }
+#endif
+}
+
+#if defined(RADIO_GPIO_IRQ)
+void RADIO_EXTI_IRQHandler(void)
+{
+    TRACE_BEGIN(TR_RADIO);
+
+    if ((EXTI->PR & RADIO_EXTI_LINE) != (uint32_t)RESET) {
+        EXTI->PR = RADIO_EXTI_LINE;
+        nrfIsr();
+
+        // Still asserted means another event arrived while we were serving
+        // this one, re-pend in software since there will be no new edge
+        if (!(RADIO_GPIO_IRQ_PORT->IDR & RADIO_GPIO_IRQ)) {
+            EXTI->SWIER = RADIO_EXTI_LINE;
+        }
+    }
+
+    TRACE_END(TR_RADIO);
+}
+#endif
+
 void nrfSetChannel(unsigned int channel)
 {
     if (channel < 126) {
@@ -399,6 +555,27 @@ void nrfInit(void)
     GPIO_PinAFConfig(GPIOA, RADIO_GPIO_SPI_MOSI, GPIO_AF_0);
     GPIO_PinAFConfig(GPIOA, RADIO_GPIO_SPI_MISO, GPIO_AF_0);
 
+#if defined(RADIO_GPIO_IRQ)
+    // IRQ pin, active low, falling edge on EXTI. Left masked in the NVIC
+    // until nrfSetInterruptEnable() is called.
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+    GPIO_InitStructure.GPIO_Pin = RADIO_GPIO_IRQ;
+    GPIO_Init(RADIO_GPIO_IRQ_PORT, &GPIO_InitStructure);
+
+    SYSCFG_EXTILineConfig(RADIO_EXTI_PORTSOURCE, RADIO_EXTI_PINSOURCE);
+
+    EXTI_InitTypeDef EXTI_InitStruct;
+    EXTI_InitStruct.EXTI_Line = RADIO_EXTI_LINE;
+    EXTI_InitStruct.EXTI_Mode = EXTI_Mode_Interrupt;
+    EXTI_InitStruct.EXTI_Trigger = EXTI_Trigger_Falling;
+    EXTI_InitStruct.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStruct);
+
+    NVIC_SetPriority(RADIO_EXTI_IRQn, 2);
+    NVIC_DisableIRQ(RADIO_EXTI_IRQn);
+#endif
+
     // disable the chip select
     RADIO_DIS_CS();
 
@@ -412,6 +589,7 @@ void nrfInit(void)
     SPI_InitStructure.SPI_CPOL = SPI_CPOL_Low;
     SPI_InitStructure.SPI_CPHA = SPI_CPHA_1Edge;
     SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
+    // 48MHz / 8 = 6MHz, the BK2423 is only rated to 8MHz so /4 is too fast
     SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_8;
     SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
     SPI_InitStructure.SPI_CRCPolynomial = 7;
@@ -420,6 +598,30 @@ void nrfInit(void)
     // Set interrupt on 8-bit return
     SPI_RxFIFOThresholdConfig(RADIO_SPI, SPI_RxFIFOThreshold_QF);
 
+    // Burst DMA channels, addresses fixed, only the counts change per transfer
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_InitTypeDef DMA_InitStructure;
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &RADIO_SPI->DR;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) burstRx;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_Init(DMA1_Channel2, &DMA_InitStructure);
+    DMA_ITConfig(DMA1_Channel2, DMA_IT_TC, ENABLE);
+
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) burstTx;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_Init(DMA1_Channel3, &DMA_InitStructure);
+
+    // Above the radio IRQ so a burst can complete under a waiting callback
+    NVIC_SetPriority(DMA1_Channel2_3_IRQn, 1);
+    NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+
     // Enable the SPI
     SPI_Cmd(RADIO_SPI, ENABLE);
 
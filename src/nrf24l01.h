@@ -159,9 +159,18 @@ void nrfIsr(void);
 #define NRF24_PWR_m6dBm                                 0x04
 #define NRF24_PWR_0dBm                                  0x06
 
+// #define NRF24_REG_17_FIFO_STATUS                        0x17
+#define NRF24_TX_REUSE                                  0x40
+#define NRF24_TX_FULL                                   0x20
+#define NRF24_TX_EMPTY                                  0x10
+#define NRF24_RX_FULL                                   0x02
+#define NRF24_RX_EMPTY                                  0x01
+
 #define NRF24_ENAA_PA (NRF24_ENAA_P0 | NRF24_ENAA_P1 | NRF24_ENAA_P2 | NRF24_ENAA_P3 | NRF24_ENAA_P4 | NRF24_ENAA_P5)
 #define NRF24_ERX_PA (NRF24_ERX_P0 | NRF24_ERX_P1 | NRF24_ERX_P2 | NRF24_ERX_P3 | NRF24_ERX_P4 | NRF24_ERX_P5)
 #define NRF_STATUS_CLEAR 0x70
+#define NRF_STATUS_RX_P_NO 0x0E
+#define NRF_STATUS_RX_EMPTY 0x0E
 
 // SPI commands
 #define CMD_R_REG               0x00
@@ -190,6 +199,7 @@ unsigned char nrfWrite1Reg(unsigned char address, char byte);
 
 //Interrupt access
 void nrfSetInterruptCallback(void (*cb)(void));
+void nrfSetInterruptEnable(bool enable);
 
 // Low level functionality of the nrf chip
 unsigned char nrfNop(void);
@@ -200,11 +210,13 @@ unsigned char nrfActivate(void);
 unsigned char nrfActivateBK2423(void);
 unsigned char nrfWriteAck(unsigned int pipe, char* buffer, int len);
 unsigned char nrfReadRX(char* buffer, int len);
+int nrfReceive(char* buffer, int len, int* dropped);
 void nrfSetChannel(unsigned int channel);
 void nrfSetDatarate(int datarate);
 void nrfSetAddress(unsigned int pipe, char* address);
 void nrfSetEnable(bool enable);
 unsigned char nrfGetStatus(void);
+uint32_t nrfTransactions(void);
 
 
 
@@ -0,0 +1,124 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Control loop stage profiler.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#if defined(PROFILER)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;           // wraps after ~90s in the stage, report sooner
+    uint16_t hist[PROF_BUCKETS];
+} profStage_t;
+
+static profStage_t profStages[PROF_STAGES];
+
+
+static uint8_t* profPut32(uint8_t* p, uint32_t v)
+{
+    *p++ = v;
+    *p++ = v >> 8;
+    *p++ = v >> 16;
+    *p++ = v >> 24;
+    return p;
+}
+
+
+// No CLZ on the M0, halve the range instead
+static uint8_t profBucket(uint32_t spent)
+{
+    uint8_t b = 0;
+
+    if (spent >= 1 << 8) {
+        spent >>= 8;
+        b += 8;
+    }
+
+    if (spent >= 1 << 4) {
+        spent >>= 4;
+        b += 4;
+    }
+
+    if (spent >= 1 << 2) {
+        spent >>= 2;
+        b += 2;
+    }
+
+    if (spent >= 1 << 1) {
+        b += 1;
+    }
+
+    return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+
+void profileRecord(uint8_t stage, uint32_t spent)
+{
+    profStage_t* s = &profStages[stage];
+    uint16_t* h = &s->hist[profBucket(spent)];
+
+    if (spent < s->min || s->count == 0) {
+        s->min = spent;
+    }
+
+    if (spent > s->max) {
+        s->max = spent;
+    }
+
+    s->count++;
+    s->sum += spent;
+
+    if (*h < 0xFFFF) {
+        (*h)++;
+    }
+}
+
+
+// Stage statistics for MSP2_CX10_PROFILE, then start that stage afresh.
+// Returns the payload size, 0 for an unknown stage.
+uint8_t profileReport(uint8_t stage, uint8_t* out)
+{
+    profStage_t* s;
+    uint8_t* p = out;
+    uint8_t i;
+
+    if (stage >= PROF_STAGES) {
+        return 0;
+    }
+
+    s = &profStages[stage];
+
+    *p++ = stage;
+    p = profPut32(p, s->count);
+    p = profPut32(p, s->min);
+    p = profPut32(p, s->count ? s->sum / s->count : 0);
+    p = profPut32(p, s->max);
+
+    for (i = 0; i < PROF_BUCKETS; i++) {
+        *p++ = s->hist[i];
+        *p++ = s->hist[i] >> 8;
+    }
+
+    memset(s, 0, sizeof(*s));
+
+    return p - out;
+}
+
+#endif
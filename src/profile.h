@@ -0,0 +1,35 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+// Loop profiler (PROFILER). Wrap a stage in PROFILE_BEGIN / PROFILE_END,
+// both expand to nothing when the profiler is off. A probe pair costs a
+// SysTick read at the start and a short accumulate at the end, times are
+// CPU cycles (48 per us).
+enum {
+    PROF_MPU,
+    PROF_RX,
+    PROF_PID,
+    PROF_MIX,
+    PROF_ADC,
+    PROF_TELEMETRY,
+    PROF_STAGES
+};
+
+#define PROF_BUCKETS 16     // log2 of cycles, last bucket catches 2^15 and up
+
+#if defined(PROFILER)
+
+#define PROFILE_BEGIN(stage)    uint32_t profStart_##stage = cycles()
+#define PROFILE_END(stage)      profileRecord(stage, cyclesSince(profStart_##stage))
+
+void profileRecord(uint8_t stage, uint32_t spent);
+uint8_t profileReport(uint8_t stage, uint8_t* out);
+
+#else
+
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Radio frame encoding.
+
+    Kept apart from nrf24RX.c and free of hardware headers, so the
+    host tests in tests/ can build it with plain gcc.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "rfframe.h"
+
+#define clamp(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+
+// YD717 frames end in the inverted sum of the first eight bytes
+bool rfValidFrame(const char* packet)
+{
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 0; i < RF_FRAME_SIZE - 1; i++) {
+        sum += packet[i];
+    }
+
+    return (uint8_t) ~sum == (uint8_t) packet[RF_FRAME_SIZE - 1];
+}
+
+
+void rfFrameCommands(const char* packet, int16_t* commands)
+{
+    const uint8_t* rf = (const uint8_t*) packet;
+
+    // FC order: T   A   E   R   A1   A2
+    // RF order: T    R   ?   E   A     Et    At   F   ?
+
+    // PPM firmware expects a range of 1000, TX range is 0xFF (max rate), mid-stick is 0x40,
+    // BS twice leads to a range of 1020, which is close enough for now.
+    commands[0] = clamp(((int16_t) rf[0]) << 2, 0, 1000);
+    commands[1] = clamp((((int16_t) rf[4]) << 2) - 512, -500, 500);
+    commands[2] = clamp((((int16_t) rf[3]) << 2) - 512, -500, 500);
+    commands[3] = clamp((((int16_t) rf[1]) << 2) - 512, -500, 500);
+
+    // Forward flip sets AUX1 high, backwards flip sets AUX1 low
+    if (rf[7] & 0x0F) {
+        if (rf[3] > 0xF0) {
+            commands[4] = 500;
+        }
+
+        if (rf[3] < 0x0F) {
+            commands[4] = -500;
+        }
+    }
+}
+
+
+static char* tlmPut16(char* p, uint16_t v)
+{
+    *p++ = v;
+    *p++ = v >> 8;
+    return p;
+}
+
+
+static uint16_t tlmGet16(const char* p)
+{
+    return (uint8_t) p[0] | ((uint8_t) p[1] << 8);
+}
+
+
+int rfTlmEncode(char* frame, uint8_t type, uint8_t seq, const rfTlm_t* tlm)
+{
+    char* p = frame;
+
+    *p++ = (type << 4) | (seq & 0x0F);
+
+    switch (type) {
+    case TLM_BATTERY:
+        p = tlmPut16(p, tlm->lipoVolt);
+        *p++ = tlm->armed;
+        *p++ = tlm->soc;
+        break;
+
+    case TLM_LINK:
+        p = tlmPut16(p, tlm->received);
+        p = tlmPut16(p, tlm->expected);
+        p = tlmPut16(p, tlm->rejected);
+        p = tlmPut16(p, tlm->rpdHits);
+        break;
+
+    case TLM_LOOP:
+        p = tlmPut16(p, tlm->loopOverruns);
+        p = tlmPut16(p, tlm->i2cErrors);
+        break;
+    }
+
+    return p - frame;
+}
+
+
+int rfTlmDecode(const char* frame, int len, rfTlm_t* tlm, uint8_t* seq)
+{
+    static const uint8_t sizes[TLM_TYPES] = {5, 9, 5};
+    uint8_t type;
+
+    if (len < 1) {
+        return -1;
+    }
+
+    type = (uint8_t) frame[0] >> 4;
+
+    if (type >= TLM_TYPES || len != sizes[type]) {
+        return -1;
+    }
+
+    *seq = frame[0] & 0x0F;
+    frame++;
+
+    switch (type) {
+    case TLM_BATTERY:
+        tlm->lipoVolt = tlmGet16(frame);
+        tlm->armed = frame[2];
+        tlm->soc = frame[3];
+        break;
+
+    case TLM_LINK:
+        tlm->received = tlmGet16(frame);
+        tlm->expected = tlmGet16(frame + 2);
+        tlm->rejected = tlmGet16(frame + 4);
+        tlm->rpdHits = tlmGet16(frame + 6);
+        break;
+
+    case TLM_LOOP:
+        tlm->loopOverruns = tlmGet16(frame);
+        tlm->i2cErrors = tlmGet16(frame + 2);
+        break;
+    }
+
+    return type;
+}
@@ -0,0 +1,51 @@
+#ifndef __RFFRAME_H__
+#define __RFFRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Radio frame encoding, no hardware access so tests/ builds it on the host.
+
+// YD717 command frame: T R ? E A Et At F checksum
+#define RF_FRAME_SIZE   9
+
+// Checksum check, true if the frame may be used
+bool rfValidFrame(const char* packet);
+
+// Sticks and flip switch of a valid frame into commands (Throttle, Roll,
+// Pitch, Yaw, Aux1), Aux1 only changes on a flip
+void rfFrameCommands(const char* packet, int16_t* commands);
+
+// ACK payload telemetry (RF_TELEMETRY). Byte 0 is (type << 4) | sequence,
+// the sequence counts frames modulo 16 so the TX can spot lost frames.
+// Fields follow little endian:
+//   TLM_BATTERY  int16 LiPoVolt (10mV), uint8 Armed, uint8 state of charge (%)
+//   TLM_LINK     uint16 received, expected, rejected, rpdHits (rfLinkStats)
+//   TLM_LOOP     uint16 loopOverruns, int16 I2C_Errors
+#define TLM_BATTERY     0
+#define TLM_LINK        1
+#define TLM_LOOP        2
+#define TLM_TYPES       3
+#define TLM_FRAME_MAX   9
+
+// Everything the telemetry frames carry, each frame type uses its own fields
+typedef struct {
+    int16_t lipoVolt;
+    uint8_t armed;
+    uint8_t soc;
+    uint16_t received;
+    uint16_t expected;
+    uint16_t rejected;
+    uint16_t rpdHits;
+    uint16_t loopOverruns;
+    int16_t i2cErrors;
+} rfTlm_t;
+
+// Frame of the given type into frame (TLM_FRAME_MAX bytes), returns its length
+int rfTlmEncode(char* frame, uint8_t type, uint8_t seq, const rfTlm_t* tlm);
+
+// TX side: fill the fields carried by frame, returns its type, or -1 if the
+// type is unknown or the length doesn't match it
+int rfTlmDecode(const char* frame, int len, rfTlm_t* tlm, uint8_t* seq);
+
+#endif
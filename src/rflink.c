@@ -0,0 +1,125 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Radio link timing.
+
+    Kept apart from nrf24RX.c and free of hardware headers, so the
+    host tests in tests/ can build it with plain gcc.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "rflink.h"
+
+
+// The packet period is learned from gaps of a few periods between arrivals
+// known to within LINK_TIGHT. The estimates jump by a control cycle as the
+// loop slides past the packets, so the filter is slow. Gaps count the slots
+// the TX sent into, at most a second's worth so an outage can't wrap
+// expected. A drain of several packets fills at least as many slots, the
+// gap covers them when it spans the earlier ones.
+uint32_t rfLinkPacket(rfLink_t* link, rfLinkStats_t* acc, uint32_t earliest,
+                      uint32_t now, int count)
+{
+    uint32_t spread = now - earliest;
+    uint32_t arrival;
+    uint32_t gap;
+    uint32_t slots;
+    bool tight;
+
+    // The newest packet landed within the last period whatever the bound
+    if (spread > link->period) {
+        spread = link->period;
+        earliest = now - spread;
+    }
+
+    arrival = now - spread / 2;
+
+    // A loose bound, from a sparse poll or the window missing the packet:
+    // the predicted arrival moved into it is closer than its middle. A lock
+    // running late is pulled back to the poll that found the packet, one
+    // running early forward to the last poll that didn't.
+    if (spread > LINK_TIGHT && link->seeded) {
+        uint32_t slot = (arrival - link->last + link->period / 2) / link->period;
+        uint32_t predicted = link->last + (slot ? slot : 1) * link->period;
+        int32_t offset = predicted - earliest;
+
+        arrival = offset < 0 ? earliest : offset > (int32_t) spread ? now : predicted;
+    }
+
+    gap = arrival - link->last;
+    tight = spread <= LINK_TIGHT && link->before + link->after <= LINK_TIGHT;
+
+    link->last = arrival;
+    link->before = arrival - earliest;
+    link->after = now - arrival;
+    acc->received += count;
+
+    // First packet, there is no gap to measure
+    if (!link->seeded) {
+        link->seeded = true;
+        acc->expected += count;
+        return arrival;
+    }
+
+    if (gap > 1000000) {
+        slots = 1000000 / link->period;
+    } else {
+        slots = (gap + link->period / 2) / link->period;
+    }
+
+    if (slots >= 1 && slots <= POLL_LOCK && count == 1 && tight) {
+        link->period += ((int32_t)(gap / slots) - link->period) / 32;
+    }
+
+    acc->expected += slots > (uint32_t) count ? slots : count;
+
+    if (gap > 0xFFFF) {
+        gap = 0xFFFF;
+    }
+
+    link->gapSum += gap;
+    link->gaps++;
+
+    if (gap < acc->gapMin) {
+        acc->gapMin = gap;
+    }
+
+    if (gap > acc->gapMax) {
+        acc->gapMax = gap;
+    }
+
+    return arrival;
+}
+
+
+// Every cycle from POLL_EARLY before to POLL_LATE after each predicted
+// arrival, widened by the uncertainty of the last one. The window around
+// the last packet itself is skipped, one as wide as the period is open
+// all the way.
+bool rfLinkWindow(const rfLink_t* link, uint32_t now)
+{
+    uint32_t early = POLL_EARLY + link->before;
+    uint32_t width = early + POLL_LATE + link->after;
+    uint32_t since = now - link->last + early;
+
+    if (!link->seeded || since >= POLL_LOCK * (uint32_t) link->period + width) {
+        return false;
+    }
+
+    if (width >= link->period) {
+        return true;
+    }
+
+    return since >= link->period && since % link->period < width;
+}
@@ -0,0 +1,60 @@
+#ifndef __RFLINK_H__
+#define __RFLINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Radio link timing: packet period, slot accounting and the polled mode
+// receive window. No hardware access so tests/ builds it on the host.
+
+#define LINK_PERIOD     20000   // us, initial guess of the TX packet period
+#define LINK_TIGHT      2500    // us, arrival uncertainty the period is learned from
+
+// Polled mode window around the predicted arrival. Both sides are more
+// than a control cycle (2000us), so a poll in the window finds the FIFO
+// still empty before the packet lands and bounds its arrival, and the poll
+// that finds it falls in the window too. The window
+// widens by the uncertainty of the last arrival, after a packet found by a
+// sparse poll it covers everything between that poll and the one before.
+#define POLL_EARLY      2500    // us before the predicted arrival
+#define POLL_LATE       2500    // us after it
+#define POLL_LOCK       4       // Periods without a packet before the window is dropped
+
+// Radio link health over the last second
+typedef struct {
+    uint16_t received;      // Packets read from the radio
+    uint16_t expected;      // Packet slots, from the learned packet period
+    uint16_t rejected;      // Frames dropped by validation
+    uint16_t rpdHits;       // Packets with carrier detect (RPD) set
+    uint16_t gapMin;        // Inter-packet gap, us
+    uint16_t gapAvg;
+    uint16_t gapMax;
+    uint16_t spi;           // SPI transactions with the radio
+    uint16_t polls;         // Status polls (polled mode only)
+    uint16_t pollMisses;    // Packets found outside the predicted window
+} rfLinkStats_t;
+
+typedef struct {
+    uint32_t last;          // Arrival of the last packet, estimated when polled
+    uint32_t gapSum;        // Gaps in the current second, for gapAvg
+    uint16_t before;        // Uncertainty of last either side, us
+    uint16_t after;
+    uint16_t gaps;
+    uint16_t period;        // Learned packet period, us
+    bool seeded;            // last holds a packet time
+} rfLink_t;
+
+#define RF_LINK_INIT    {0, 0, 0, 0, 0, LINK_PERIOD, false}
+
+// Account count packets read at now, which arrived after earliest: now if
+// the radio interrupt reported them, the previous status poll if a poll
+// found them. The arrival is taken as the predicted one moved inside that
+// bound, or halfway between when the bound is tight. Returns the estimate.
+uint32_t rfLinkPacket(rfLink_t* link, rfLinkStats_t* acc, uint32_t earliest,
+                      uint32_t now, int count);
+
+// Polled mode: true if a poll at now falls in the window around the
+// predicted arrival, false outside it or once packets stop coming
+bool rfLinkWindow(const rfLink_t* link, uint32_t now);
+
+#endif
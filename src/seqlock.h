@@ -0,0 +1,49 @@
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+// Sequence lock for data an interrupt writes and code it preempts (the
+// main loop, or a lower priority handler) reads. On the single M0 core
+// the writer always runs to completion before the reader resumes, so no
+// LDREX/STREX is needed, only compiler barriers to keep the data accesses
+// between the sequence updates. The count is odd while a write is open.
+//
+//   writer:  seqWriteBegin(&seq); ...store...; seqWriteEnd(&seq);
+//   reader:  do {
+//                start = seqReadBegin(&seq);
+//                ...copy...
+//            } while (seqReadRetry(&seq, start));
+//
+// start then also tells a reader whether anything new was published.
+// Never read from a higher priority than the writer, an open write would
+// then never close and the reader would spin.
+typedef volatile uint8_t seqlock_t;
+
+#define SEQ_BARRIER() __asm volatile("" : : : "memory")
+
+static inline void seqWriteBegin(seqlock_t* seq)
+{
+    (*seq)++;
+    SEQ_BARRIER();
+}
+
+static inline void seqWriteEnd(seqlock_t* seq)
+{
+    SEQ_BARRIER();
+    (*seq)++;
+}
+
+static inline uint8_t seqReadBegin(seqlock_t* seq)
+{
+    uint8_t start = *seq;
+
+    SEQ_BARRIER();
+    return start;
+}
+
+static inline bool seqReadRetry(seqlock_t* seq, uint8_t start)
+{
+    SEQ_BARRIER();
+    return (start & 1) || *seq != start;
+}
+
+#endif
@@ -1,12 +1,13 @@
 #include "config.h"
 
 #if defined(SERIAL_ACTIVE)
-static uint8_t rxBuffer[256];
+static uint8_t rxBuffer[256];            // circular DMA target
 static uint8_t rxBufTail = 0;
-static uint8_t rxBufHead = 0;
-static uint8_t txBufTail = 0;
+static volatile uint8_t rxBufHead = 0;  // published at idle line and half/full buffer
+static volatile uint8_t txBufTail = 0;
 static uint8_t txBufHead = 0;
-static uint8_t txOn = 0;
+static volatile uint8_t txDmaLen = 0;    // bytes in flight, 0 when idle
+uint16_t serialTxDropped = 0;
 
 
 static uint8_t txBuf[256];
@@ -44,43 +45,110 @@ void init_UART(uint32_t speed)
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-    USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);
-    USART_ITConfig(USART1, USART_IT_TC, ENABLE);
+    USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);
+
+    // USART1 moved to DMA1 ch4 (TX) and ch5 (RX), ch2/3 belong to the radio SPI
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    SYSCFG_DMAChannelRemapConfig(SYSCFG_DMARemap_USART1Tx, ENABLE);
+    SYSCFG_DMAChannelRemapConfig(SYSCFG_DMARemap_USART1Rx, ENABLE);
+
+    DMA_InitTypeDef DMA_InitStructure;
+    DMA_StructInit(&DMA_InitStructure);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &USART1->TDR;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) txBuf;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_Init(DMA1_Channel4, &DMA_InitStructure);
+    DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
+
+    // RX runs forever, the interrupts only publish how far it got
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &USART1->RDR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) rxBuffer;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = sizeof(rxBuffer);
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_Init(DMA1_Channel5, &DMA_InitStructure);
+    DMA_ITConfig(DMA1_Channel5, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA1_Channel5, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_5_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPriority = 5;
+    NVIC_Init(&NVIC_InitStructure);
+
+    USART_DMACmd(USART1, USART_DMAReq_Tx | USART_DMAReq_Rx, ENABLE);
 
     USART_Cmd(USART1, ENABLE);
 
 }
 
 
+// Bytes the RX DMA has written so far
+static void rxPublish(void)
+{
+    rxBufHead = sizeof(rxBuffer) - DMA1_Channel5->CNDTR;
+}
+
+
+// Idle line: the host has finished a frame, let the parser see it
 void USART1_IRQHandler(void)
 {
-    if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) {
-        USART_ClearITPendingBit(USART1, USART_IT_RXNE);
-        rxBuffer[rxBufHead++] = USART_ReceiveData(USART1);
-    }
+    TRACE_BEGIN(TR_USART);
 
-    if (USART_GetITStatus(USART1, USART_IT_TC) != RESET) {
-        USART_ClearITPendingBit(USART1, USART_IT_TC);
+    if (USART1->ISR & USART_ISR_IDLE) {
+        USART1->ICR = USART_ICR_IDLECF;
+        rxPublish();
+    }
 
-        if (txBufTail != txBufHead && txOn) {
-            USART_SendData(USART1, txBuf[txBufTail++]);
-        } else {
-            txOn = 0;
-            USART_ITConfig(USART1, USART_IT_TC, DISABLE);
-            StartUSART();
-        }
+    if (USART1->ISR & USART_ISR_ORE) {
+        USART1->ICR = USART_ICR_ORECF;
     }
+
+    TRACE_END(TR_USART);
 }
 
 
+// Hand the oldest contiguous run of queued bytes to the DMA. A run that
+// wraps the end of txBuf goes out as two transfers.
+void TX_DMA(void)
+{
+    uint8_t head = txBufHead;
+    uint8_t tail = txBufTail;
+
+    if (txDmaLen || head == tail) {
+        return;
+    }
+
+    txDmaLen = (head > tail) ? head - tail : 256 - tail;
 
-void StartUSART(void)
+    DMA1_Channel4->CMAR = (uint32_t) &txBuf[tail];
+    DMA1_Channel4->CNDTR = txDmaLen;
+    DMA1_Channel4->CCR |= DMA_CCR_EN;
+}
+
+
+void DMA1_Channel4_5_IRQHandler(void)
 {
-    if (!txOn && txBufHead != txBufTail) {
-        txOn = 1;
-        USART_ITConfig(USART1, USART_IT_TC, ENABLE);
-        USART_SendData(USART1, txBuf[txBufTail++]);
+    TRACE_BEGIN(TR_SERIAL_DMA);
+
+    if (DMA1->ISR & DMA1_FLAG_TC4) {
+        DMA1->IFCR = DMA1_FLAG_GL4;
+        DMA1_Channel4->CCR &= ~DMA_CCR_EN;
+
+        txBufTail += txDmaLen;
+        txDmaLen = 0;
+        TX_DMA();
+    }
+
+    // Long streams without a gap still get through every half buffer
+    if (DMA1->ISR & (DMA1_FLAG_HT5 | DMA1_FLAG_TC5)) {
+        DMA1->IFCR = DMA1_FLAG_HT5 | DMA1_FLAG_TC5;
+        rxPublish();
     }
+
+    TRACE_END(TR_SERIAL_DMA);
 }
 
 
@@ -100,15 +168,29 @@ uint8_t serial_read(void)
     }
 }
 
+// Bytes that can be queued without overwriting unsent data
+uint8_t serial_tx_free(void)
+{
+    return 255 - (uint8_t)(txBufHead - txBufTail);
+}
+
+
+// Queue n bytes, all or nothing so frames are never cut. A write that
+// doesn't fit is counted in serialTxDropped.
 void serial_send_bytes(uint8_t* s, int n)
 {
-    uint8_t  i = 0;
+    int i = 0;
+
+    if (n > serial_tx_free()) {
+        serialTxDropped += n;
+        return;
+    }
 
     while (i < n) {
         txBuf[txBufHead++] = s[i++];
     }
 
-    StartUSART();
+    TX_DMA();
 }
 
 
@@ -5,5 +5,5 @@ void TX_DMA(void);
 uint8_t serial_available(void);
 uint8_t serial_read(void);
 void serial_send_bytes(uint8_t* s, int n);
+uint8_t serial_tx_free(void);
 void print_int16(int16_t p_int);
-void StartUSART(void);
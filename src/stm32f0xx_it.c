@@ -29,6 +29,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f0xx_it.h"
+#include "config.h"
 
 /** @addtogroup STM32F0_Discovery_Peripheral_Examples
   * @{
@@ -65,6 +66,11 @@ void NMI_Handler(void)
   */
 void HardFault_Handler(void)
 {
+#if defined(FLIGHT_RECORDER)
+    /* Reset and report the recorded cycles after boot */
+    flightRecFault();
+#endif
+
     /* Go to infinite loop when Hard Fault exception occurs */
     while (1) {
     }
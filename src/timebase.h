@@ -0,0 +1,35 @@
+#ifndef __TIMEBASE_H__
+#define __TIMEBASE_H__
+
+// The us timebase read: TIM3 overflow count and count as one value. No
+// hardware access of its own, so tests/ runs it on the host against a
+// simulated timer. The includer defines
+//   TB_OVERFLOWS   the overflow count the update interrupt increments
+//   TB_COUNT()     the 16 bit timer count
+//   TB_PENDING()   non zero while an update (wrap) waits for its interrupt
+//
+// A retry catches the update interrupt running between the reads; a wrap
+// it hasn't serviced yet (interrupts masked, or called from a handler that
+// blocks it) is taken from the pending flag, with the count re-read after
+// the wrap. Valid as long as no more than one wrap goes unserviced.
+static inline uint32_t readTimebase(uint16_t* count)
+{
+    uint32_t overflows;
+    uint16_t cnt;
+    uint16_t pending;
+
+    do {
+        overflows = TB_OVERFLOWS;
+        cnt = TB_COUNT();
+        pending = TB_PENDING();
+
+        if (pending) {
+            cnt = TB_COUNT();
+        }
+    } while (overflows != TB_OVERFLOWS);
+
+    *count = cnt;
+    return pending ? overflows + 1 : overflows;
+}
+
+#endif
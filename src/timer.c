@@ -19,6 +19,19 @@
 
 
 
+// CPU clock cycles, 24 bits counting up. Differences taken with
+// cyclesSince() are valid up to 2^24 / 48MHz = 349ms.
+uint32_t cycles(void)
+{
+    return CYCLES_MASK - SysTick->VAL;
+}
+
+uint32_t cyclesSince(uint32_t start)
+{
+    return (cycles() - start) & CYCLES_MASK;
+}
+
+
 void init_Timer()
 {
 
@@ -41,6 +54,11 @@ void init_Timer()
     NVIC_Init(&NVIC_InitStructure);
     TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
 
+    // SysTick free running at HCLK for cycles(), no interrupt
+    SysTick->LOAD = CYCLES_MASK;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
 #if defined(CX_10_RED_BOARD)
     GPIO_InitTypeDef gpioinitTIM;
     gpioinitTIM.GPIO_Pin = GPIO_Pin_3 | GPIO_Pin_8 | GPIO_Pin_11;
@@ -86,6 +104,11 @@ void init_Timer()
     TIM_OC1Init(TIM16, &channelbaseconf);
     TIM_OC4Init(TIM2, &channelbaseconf);
 
+    // ADC trigger, TRGO on every ADC_TRIGGER_DIV th period start
+    TIM1->RCR = ADC_TRIGGER_DIV - 1;
+    TIM_GenerateEvent(TIM1, TIM_EventSource_Update);
+    TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_Update);
+
     TIM_Cmd(TIM1, ENABLE);
     TIM_CtrlPWMOutputs(TIM1, ENABLE);
 
@@ -135,6 +158,11 @@ void init_Timer()
     TIM_OC3Init(TIM1, &channelbaseconf);
     TIM_OC4Init(TIM1, &channelbaseconf);
 
+    // ADC trigger, TRGO on every ADC_TRIGGER_DIV th period start
+    TIM1->RCR = ADC_TRIGGER_DIV - 1;
+    TIM_GenerateEvent(TIM1, TIM_EventSource_Update);
+    TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_Update);
+
     TIM_Cmd(TIM1, ENABLE);
     TIM_CtrlPWMOutputs(TIM1, ENABLE);
 #endif
@@ -1,4 +1,8 @@
 
 
 
+#define CYCLES_MASK 0x00FFFFFF
+
 void init_Timer(void);
+uint32_t cycles(void);
+uint32_t cyclesSince(uint32_t start);
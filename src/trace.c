@@ -0,0 +1,88 @@
+/*  Cheerson CX-10 integrated RF rate mode firmware.
+     - Event trace ring, drained over serial.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "config.h"
+
+#if defined(TRACE)
+
+static uint32_t traceBuf[TRACE_ENTRIES];
+static volatile uint16_t traceHead = 0;
+static volatile uint16_t traceTail = 0;
+static volatile uint16_t traceLost = 0;
+
+
+// Callable from any priority. The M0 has no exclusive load/store, so the
+// slot is claimed and written with interrupts off for a few instructions.
+// The timestamp is read in there too, an interrupt between the read and the
+// claim would otherwise log later entries ahead of this earlier one.
+void traceEvent(uint8_t id, uint8_t arg)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t entry;
+
+    __disable_irq();
+
+    entry = ((uint32_t)TIM3->CNT << 16) | (id << 8) | arg;
+
+    if ((uint16_t)(traceHead - traceTail) < TRACE_ENTRIES) {
+        traceBuf[traceHead++ % TRACE_ENTRIES] = entry;
+    } else {
+        traceLost++;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+
+// Call from the loop, sends a frame whenever the TX buffer has room
+void traceDrain(void)
+{
+    uint8_t payload[2 + TRACE_PER_FRAME * 4];
+    uint8_t* p = payload;
+    uint16_t tail = traceTail;
+    uint16_t lost;
+    uint8_t n = 0;
+
+    if (tail == traceHead || serial_tx_free() < MSP_FRAME_OVERHEAD + sizeof(payload)) {
+        return;
+    }
+
+    __disable_irq();
+    lost = traceLost;
+    traceLost = 0;
+    __enable_irq();
+
+    *p++ = lost;
+    *p++ = lost >> 8;
+
+    while (n < TRACE_PER_FRAME && tail != traceHead) {
+        uint32_t entry = traceBuf[tail++ % TRACE_ENTRIES];
+
+        *p++ = entry;
+        *p++ = entry >> 8;
+        *p++ = entry >> 16;
+        *p++ = entry >> 24;
+        n++;
+    }
+
+    traceTail = tail;
+
+    mspSendFrame(MSP2_CX10_TRACE, payload, p - payload);
+}
+
+#endif
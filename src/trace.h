@@ -0,0 +1,41 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// Event trace (TRACE). Each entry is one word, TIM3 count (us) in the top
+// 16 bits, event ID in bits 8-15 (bit 7 of the ID set on the end of a
+// span), argument in bits 0-7. Entries are drained as MSP2_CX10_TRACE
+// frames: uint16 entries lost since the previous frame, then up to
+// TRACE_PER_FRAME entries, oldest first, little endian. The timestamp
+// wraps every 65.5ms, the TIM3 overflow is itself traced so a reader
+// always sees at least one entry per wrap while the ring isn't full.
+// When the ring is full new entries are lost, not old ones, so what
+// arrives is contiguous windows of activity.
+enum {
+    TR_LOOP,            // control cycle, ends where the idle wait starts
+    TR_TIM3,            // TIM3_IRQHandler
+    TR_USART,           // USART1_IRQHandler
+    TR_SERIAL_DMA,      // DMA1_Channel4_5_IRQHandler
+    TR_PPM,             // EXTI4_15_IRQHandler
+    TR_RADIO,           // radio EXTI
+    TR_SPI_DMA          // DMA1_Channel2_3_IRQHandler
+};
+
+#define TR_END          0x80
+#define TRACE_PER_FRAME 15
+
+#if defined(TRACE)
+
+#define TRACE_BEGIN(id)     traceEvent(id, 0)
+#define TRACE_END(id)       traceEvent((id) | TR_END, 0)
+
+void traceEvent(uint8_t id, uint8_t arg);
+void traceDrain(void);
+
+#else
+
+#define TRACE_BEGIN(id)
+#define TRACE_END(id)
+
+#endif
+
+#endif
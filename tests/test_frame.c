@@ -0,0 +1,185 @@
+/*  YD717 frame validation fuzz and throughput (rfframe.c).
+
+    Millions of random and mutated frames go through rfValidFrame() and
+    rfFrameCommands() the way rfRxIsr() and get_RFRXDatas() use them:
+      - every well formed frame is accepted,
+      - every single or double bit flip of one is refused,
+      - random frames get through at about the 1/256 the checksum allows,
+      - whatever gets through decodes to commands inside their ranges.
+    The time per frame is printed, and has to stay far below a control
+    cycle (2000us) even on the host.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rfframe.h"
+
+#define FRAMES      4000000
+#define MAX_NS      1000    // per frame, host time, generous
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+
+static uint32_t rng = 1;
+
+static uint8_t rand8(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 16;
+}
+
+
+static void seal(char* frame)
+{
+    uint8_t sum = 0;
+    int i;
+
+    for (i = 0; i < RF_FRAME_SIZE - 1; i++) {
+        sum += frame[i];
+    }
+
+    frame[RF_FRAME_SIZE - 1] = ~sum;
+}
+
+
+static void checkCommands(const int16_t* commands)
+{
+    int i;
+
+    CHECK(commands[0] >= 0 && commands[0] <= 1000);
+
+    for (i = 1; i < 5; i++) {
+        CHECK(commands[i] >= -500 && commands[i] <= 500);
+    }
+}
+
+
+static void wellFormed(void)
+{
+    char frame[RF_FRAME_SIZE];
+    int16_t commands[6] = {0, 0, 0, 0, -500, 0};
+    int n, i, a, b;
+
+    for (n = 0; n < FRAMES / 16; n++) {
+        for (i = 0; i < RF_FRAME_SIZE; i++) {
+            frame[i] = rand8();
+        }
+
+        seal(frame);
+
+        CHECK(rfValidFrame(frame));
+
+        rfFrameCommands(frame, commands);
+        checkCommands(commands);
+
+        // A sum check catches any single bit and most double bit errors,
+        // two flips of the same bit position in opposite directions cancel
+        for (a = 0; a < RF_FRAME_SIZE * 8; a++) {
+            frame[a / 8] ^= 1 << (a % 8);
+            CHECK(!rfValidFrame(frame));
+
+            b = rand8() % (RF_FRAME_SIZE * 8);
+
+            if (b != a) {
+                frame[b / 8] ^= 1 << (b % 8);
+
+                if (a % 8 != b % 8) {
+                    CHECK(!rfValidFrame(frame));
+                }
+
+                frame[b / 8] ^= 1 << (b % 8);
+            }
+
+            frame[a / 8] ^= 1 << (a % 8);
+        }
+
+        if (failures) {
+            return;
+        }
+    }
+}
+
+
+static void randomFrames(void)
+{
+    char frame[RF_FRAME_SIZE];
+    int16_t commands[6] = {0, 0, 0, 0, -500, 0};
+    uint32_t accepted = 0;
+    int n, i;
+
+    for (n = 0; n < FRAMES; n++) {
+        for (i = 0; i < RF_FRAME_SIZE; i++) {
+            frame[i] = rand8();
+        }
+
+        if (rfValidFrame(frame)) {
+            accepted++;
+            rfFrameCommands(frame, commands);
+            checkCommands(commands);
+        }
+    }
+
+    // 1/256 expected, 15625 of 4M
+    CHECK(accepted > FRAMES / 300 && accepted < FRAMES / 220);
+}
+
+
+static void throughput(void)
+{
+    static char frames[256][RF_FRAME_SIZE];
+    int16_t commands[6] = {0, 0, 0, 0, -500, 0};
+    struct timespec t0, t1;
+    uint32_t accepted = 0;
+    double ns;
+    int n, i;
+
+    for (n = 0; n < 256; n++) {
+        for (i = 0; i < RF_FRAME_SIZE; i++) {
+            frames[n][i] = rand8();
+        }
+
+        if (n & 1) {
+            seal(frames[n]);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (n = 0; n < FRAMES; n++) {
+        if (rfValidFrame(frames[n & 255])) {
+            rfFrameCommands(frames[n & 255], commands);
+            accepted++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / FRAMES;
+
+    printf("%d frames, %u accepted, %.1f ns/frame\n", FRAMES, accepted, ns);
+
+    CHECK(accepted >= FRAMES / 2);
+    CHECK(ns < MAX_NS);
+}
+
+
+int main(void)
+{
+    wellFormed();
+    randomFrames();
+    throughput();
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+
+    return failures != 0;
+}
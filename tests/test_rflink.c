@@ -0,0 +1,231 @@
+/*  Polled radio link lock and slot accounting (rflink.c).
+
+    A TX sends a packet every period (a little off the nominal 20ms, with
+    jitter and losses) into a 3 deep FIFO, and the control loop polls it
+    the way poll_RFRX() does: every 2ms cycle inside rfLinkWindow(), every
+    POLL_SPARSE-th cycle outside it. From a cold start at every phase, and
+    from a lock placed 10ms late, the loop has to:
+      - pick up each packet within a control cycle of its arrival once it
+        has locked, a few periods in, except the first after POLL_LOCK
+        losses in a row, which drop the window,
+      - learn the period,
+      - never count more packets received than slots expected, also when
+        a stalled loop drains several packets at once, and count the
+        slots the TX actually sent.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rflink.h"
+
+#define CYCLE       2000    // us, control loop
+#define POLL_SPARSE 8       // as nrf24RX.c
+#define FIFO_DEPTH  3
+#define SETTLE      5       // periods allowed to lock
+#define RUN         100     // periods per run
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+
+static uint32_t rng = 1;
+
+static uint32_t rand32(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+
+typedef struct {
+    uint32_t maxLatency;    // after SETTLE periods
+    uint32_t sent;          // from the first packet received to the last
+    uint32_t received;
+    uint32_t expected;
+    uint32_t polls;
+} result_t;
+
+
+// One run. The loop starts at phase, late seeds a lock as if the packet
+// before the first had been picked up that long after it landed (0 for a
+// cold start), lossPct of the packets are lost, and
+// the loop stalls for stall us once, halfway through.
+static void run(uint16_t period, uint32_t phase, uint32_t late, int lossPct,
+                uint32_t stall, rfLink_t* link, result_t* r)
+{
+    rfLinkStats_t acc;
+    uint32_t fifo[FIFO_DEPTH];
+    bool relock[FIFO_DEPTH];
+    int queued = 0;
+    int lost = 0;
+    uint32_t sent = 0;
+    uint32_t first = late ? 0 : 0xFFFFFFFF;
+    uint32_t tx = 100000;
+    uint32_t t = 100000 + phase;
+    uint32_t pollLast = 0;
+    uint32_t end = tx + RUN * period;
+    uint32_t stallAt = tx + RUN / 2 * period;
+    uint8_t sparse = 0;
+    int i;
+
+    memset(&acc, 0, sizeof(acc));
+    memset(r, 0, sizeof(*r));
+    acc.gapMin = 0xFFFF;
+
+    if (late) {
+        link->last = tx - period + late;
+        link->seeded = true;
+    }
+
+    while (t < end) {
+        // Packets landed since the previous cycle, a full FIFO refuses them
+        while ((int32_t)(tx - t) <= 0) {
+            if ((int)(rand32() % 100) >= lossPct) {
+                if (queued < FIFO_DEPTH) {
+                    relock[queued] = lost >= POLL_LOCK;
+                    fifo[queued++] = tx;
+                }
+
+                if (first > sent) {
+                    first = sent;
+                }
+
+                r->sent = sent + 1 - first;
+                lost = 0;
+            } else {
+                lost++;
+            }
+
+            sent++;
+
+            tx += period + (int32_t)(rand32() % 61) - 30;
+        }
+
+        if (rfLinkWindow(link, t) || ++sparse >= POLL_SPARSE) {
+            sparse = 0;
+            r->polls++;
+
+            if (queued) {
+                // Locked: past the start, and past the stall
+                bool locked = t > 100000 + SETTLE * period &&
+                              !(stall && t >= stallAt && t < stallAt + stall + SETTLE * period);
+
+                for (i = 0; i < queued; i++) {
+                    if (locked && !relock[i] && t - fifo[i] > r->maxLatency) {
+                        r->maxLatency = t - fifo[i];
+                    }
+                }
+
+                rfLinkPacket(link, &acc, pollLast, t, queued);
+                queued = 0;
+            }
+
+            pollLast = t;
+        }
+
+        if (stall && t < stallAt && t + CYCLE >= stallAt) {
+            t += stall;
+        }
+
+        t += CYCLE + rand32() % 20;
+
+        // The firmware publishes the stats every second, keep them from wrapping
+        if (acc.received > 1000) {
+            r->received += acc.received;
+            r->expected += acc.expected;
+            acc.received = acc.expected = 0;
+        }
+    }
+
+    r->received += acc.received;
+    r->expected += acc.expected;
+}
+
+
+static void locking(void)
+{
+    uint32_t worst = 0;
+    uint32_t polls = 0;
+    uint32_t runs = 0;
+    uint32_t phase;
+    int lossPct;
+
+    for (phase = 0; phase < 20000; phase += 250) {
+        for (lossPct = 0; lossPct <= 30; lossPct += 15) {
+            uint16_t period = 19900 + rand32() % 200;
+            uint32_t late;
+
+            for (late = 0; late <= 10000; late += 10000) {
+                rfLink_t link = RF_LINK_INIT;
+                result_t r;
+
+                run(period, phase, late, lossPct, 0, &link, &r);
+
+                CHECK(r.maxLatency <= CYCLE + 50);
+                CHECK(abs((int) link.period - period) < 100);
+                CHECK(r.received <= r.expected);
+                CHECK(r.expected + 2 >= r.sent && r.expected <= r.sent + 2);
+
+                if (failures) {
+                    printf("period %u phase %u loss %d%% late %u: latency %u period %u "
+                           "received %u expected %u sent %u\n", period, phase, lossPct, late,
+                           r.maxLatency, link.period, r.received, r.expected, r.sent);
+                    return;
+                }
+
+                if (r.maxLatency > worst) {
+                    worst = r.maxLatency;
+                }
+
+                polls += r.polls;
+                runs++;
+            }
+        }
+    }
+
+    printf("worst latency %uus, %.1f polls per period\n", worst, (double) polls / runs / RUN);
+}
+
+
+// A loop stall drains a full FIFO at once, the drain must not count more
+// packets than slots
+static void stalls(void)
+{
+    uint32_t stall;
+
+    for (stall = 20000; stall <= 120000; stall += 7000) {
+        rfLink_t link = RF_LINK_INIT;
+        result_t r;
+
+        run(20000, rand32() % 20000, 0, 0, stall, &link, &r);
+
+        CHECK(r.received <= r.expected);
+        CHECK(r.expected + 2 >= r.sent && r.expected <= r.sent + 2);
+        CHECK(r.maxLatency <= CYCLE + 50);
+
+        if (failures) {
+            printf("stall %u: latency %u received %u expected %u sent %u\n",
+                   stall, r.maxLatency, r.received, r.expected, r.sent);
+            return;
+        }
+    }
+}
+
+
+int main(void)
+{
+    locking();
+    stalls();
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+
+    return failures != 0;
+}
@@ -0,0 +1,166 @@
+/*  Sequence lock snapshots under preemption (seqlock.h).
+
+    A signal handler stands in for the interrupt: it runs on the reader's
+    own thread, at whatever instruction the reader is at, and runs to
+    completion before the reader resumes, the way an ISR preempts the loop
+    on the single M0 core. A second thread fires the signal at random
+    intervals. The writer fills every word of a block with the same
+    count, the reader copies the block, and:
+      - every snapshot the lock lets through must be whole,
+      - the writer must have hit open reads (retries), or nothing was tested,
+      - copies of the same block without the lock must tear, to show the
+        test would catch a lock that doesn't work.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "seqlock.h"
+
+#define WORDS       32
+#define SIGNALS     20000
+#define MAX_GAP_US  20
+
+static seqlock_t seq;
+static uint32_t block[WORDS];
+static volatile sig_atomic_t writes;
+static volatile bool sending;
+static pthread_t reader;
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+
+// The "interrupt"
+static void writer(int sig)
+{
+    uint32_t v = writes + 1;
+    int i;
+
+    (void) sig;
+
+    seqWriteBegin(&seq);
+
+    for (i = 0; i < WORDS; i++) {
+        block[i] = v;
+    }
+
+    seqWriteEnd(&seq);
+    writes = v;
+}
+
+
+static void* sender(void* arg)
+{
+    uint32_t rng = 1;
+    int n;
+
+    (void) arg;
+
+    for (n = 0; n < SIGNALS; n++) {
+        rng = rng * 1103515245 + 12345;
+        usleep((rng >> 16) % MAX_GAP_US);
+        pthread_kill(reader, SIGUSR1);
+    }
+
+    sending = false;
+    return NULL;
+}
+
+
+static bool whole(const uint32_t* copy)
+{
+    int i;
+
+    for (i = 1; i < WORDS; i++) {
+        if (copy[i] != copy[0]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Copy the block over and over while the signals come in
+static void run(bool locked, uint32_t* snapshots, uint32_t* retries, uint32_t* torn)
+{
+    uint32_t copy[WORDS];
+    pthread_t thread;
+    uint8_t start = 0;
+    int i;
+
+    *snapshots = *retries = *torn = 0;
+    sending = true;
+    pthread_create(&thread, NULL, sender, NULL);
+
+    while (sending) {
+        if (locked) {
+            for (;;) {
+                start = seqReadBegin(&seq);
+
+                for (i = 0; i < WORDS; i++) {
+                    copy[i] = block[i];
+                }
+
+                if (!seqReadRetry(&seq, start)) {
+                    break;
+                }
+
+                (*retries)++;
+            }
+        } else {
+            for (i = 0; i < WORDS; i++) {
+                copy[i] = ((volatile uint32_t*) block)[i];
+            }
+        }
+
+        if (!whole(copy)) {
+            (*torn)++;
+        }
+
+        (*snapshots)++;
+    }
+
+    pthread_join(thread, NULL);
+}
+
+
+int main(void)
+{
+    struct sigaction sa = {0};
+    uint32_t snapshots, retries, torn;
+
+    reader = pthread_self();
+    sa.sa_handler = writer;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    run(true, &snapshots, &retries, &torn);
+    printf("locked:   %u snapshots, %u retries, %u torn, %d writes\n",
+           snapshots, retries, torn, (int) writes);
+
+    CHECK(torn == 0);
+    CHECK(retries > 0);
+
+    run(false, &snapshots, &retries, &torn);
+    printf("unlocked: %u snapshots, %u torn\n", snapshots, torn);
+
+    CHECK(torn > 0);
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+
+    return failures != 0;
+}
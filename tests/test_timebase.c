@@ -0,0 +1,192 @@
+/*  us timebase reads around a TIM3 wrap (timebase.h).
+
+    readTimebase() runs against a simulated TIM3: every register read
+    lets some time pass, the counter wraps to a pending update, and the
+    update interrupt runs between two reads a set number of reads after
+    the wrap, or never while interrupts are masked. Starting points all
+    around the wrap, every interrupt latency and 0-3us per read are tried
+    exhaustively, then at random, and each read has to:
+      - fall between the time the call started and the time it returned,
+      - never go backwards from the read before it,
+      - finish in a few passes of its retry loop.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MASKED      -1      // interrupt latency: never serviced
+#define MAX_READS   32      // register reads per readTimebase(), generous
+
+static uint64_t simTime;        // true time, us
+static uint64_t simNextWrap;
+static uint32_t simOverflows;   // what the update interrupt counts
+static bool simPending;         // update flag
+static int simSinceWrap;        // reads since the flag was raised
+static int simLatency;          // reads from the wrap to the interrupt
+static const uint8_t* simSteps; // us passing per read, cycled
+static int simStepCount;
+static int simStep;
+static int simReads;
+
+static void simTick(void)
+{
+    simTime += simSteps[simStep++ % simStepCount];
+    simReads++;
+
+    if (simTime >= simNextWrap) {
+        simNextWrap += 0x10000;
+        simPending = true;
+        simSinceWrap = 0;
+    } else if (simPending) {
+        simSinceWrap++;
+    }
+
+    if (simPending && simLatency != MASKED && simSinceWrap >= simLatency) {
+        simPending = false;
+        simOverflows++;
+    }
+}
+
+static uint32_t simReadOverflows(void)
+{
+    simTick();
+    return simOverflows;
+}
+
+static uint16_t simReadCount(void)
+{
+    simTick();
+    return (uint16_t) simTime;
+}
+
+static uint16_t simReadPending(void)
+{
+    simTick();
+    return simPending;
+}
+
+#define TB_OVERFLOWS    simReadOverflows()
+#define TB_COUNT()      simReadCount()
+#define TB_PENDING()    simReadPending()
+#include "timebase.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+
+// micros64() on the simulated timer, checked against the true time
+static uint64_t checkedRead(void)
+{
+    uint64_t before = simTime;
+    uint64_t t;
+    uint16_t cnt;
+
+    simReads = 0;
+    t = ((uint64_t) readTimebase(&cnt) << 16) | cnt;
+
+    CHECK(t >= before && t <= simTime);
+    CHECK(simReads <= MAX_READS);
+    return t;
+}
+
+
+// Start at start, consistent with an interrupt that has kept up, let
+// idle reads pass so the wrap lands anywhere in or before the reads
+static void run(uint64_t start, int idle, int latency, const uint8_t* steps, int stepCount)
+{
+    uint64_t last;
+    int i;
+
+    simTime = start;
+    simNextWrap = (start | 0xFFFF) + 1;
+    simOverflows = start >> 16;
+    simPending = false;
+    simLatency = latency;
+    simSteps = steps;
+    simStepCount = stepCount;
+    simStep = 0;
+
+    for (i = 0; i < idle; i++) {
+        simTick();
+    }
+
+    last = checkedRead();
+
+    for (i = 0; i < 4; i++) {
+        uint64_t t = checkedRead();
+
+        CHECK(t >= last);
+        last = t;
+    }
+}
+
+
+static void exhaustive(void)
+{
+    static const uint64_t wraps[] = {0x10000, 0x12340000, 0xFFFF0000, 0xFFFFFFFF0000};
+    static const uint8_t patterns[][4] = {
+        {0, 0, 0, 1}, {1, 1, 1, 1}, {0, 1, 0, 1}, {1, 0, 0, 0},
+        {2, 0, 1, 3}, {3, 3, 3, 3}, {0, 0, 1, 2}, {1, 2, 3, 0}
+    };
+    int w, off, idle, latency, p;
+
+    for (w = 0; w < 4; w++) {
+        for (off = 1; off <= 24; off++) {
+            for (idle = 0; idle < 16; idle++) {
+                for (latency = MASKED; latency < 12; latency++) {
+                    for (p = 0; p < 8; p++) {
+                        run(wraps[w] - off, idle, latency, patterns[p], 4);
+                    }
+                }
+            }
+
+            if (failures) {
+                return;
+            }
+        }
+    }
+}
+
+
+static uint32_t rng = 1;
+
+static uint32_t rand32(void)
+{
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+
+static void randomized(void)
+{
+    uint8_t steps[64];
+    int n, i;
+
+    for (n = 0; n < 1000000 && !failures; n++) {
+        for (i = 0; i < 64; i++) {
+            steps[i] = rand32() % 4;
+        }
+
+        run(((uint64_t)(rand32() | 1) << 16) - 1 - rand32() % 40, rand32() % 20,
+            (int)(rand32() % 16) - 1, steps, 64);
+    }
+}
+
+
+int main(void)
+{
+    exhaustive();
+    randomized();
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+
+    return failures != 0;
+}
@@ -0,0 +1,209 @@
+/*  Blackbox capture to CSV.
+
+        bbdecode [capture.bin] > log.csv
+
+    Reads a raw capture of the serial port (a file, or stdin), picks the
+    MSP2_CX10_BLACKBOX frames out of it and writes one CSV row per logged
+    cycle. Anything else on the port (telemetry, MSP replies, trace) is
+    skipped, frames failing the CRC are dropped and the deltas after them
+    until the next keyframe. The once a second 'S' frames and a summary
+    go to stderr. Frame layout in src/blackbox.h.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "blackbox.h"
+#include "msp.h"
+#include "mspcapture.h"
+
+static const char* fieldNames[BB_FIELD_COUNT] = {
+    "time",
+    "gyro[0]", "gyro[1]", "gyro[2]",
+    "setpoint[0]", "setpoint[1]", "setpoint[2]",
+    "P[0]", "P[1]", "P[2]",
+    "I[0]", "I[1]", "I[2]",
+    "D[0]", "D[1]", "D[2]",
+    "motor[0]", "motor[1]", "motor[2]", "motor[3]"
+};
+
+static_assert(sizeof(fieldNames) / sizeof(fieldNames[0]) == BB_FIELD_COUNT,
+              "field names out of step with blackbox.h");
+
+
+// Varint reader over one frame payload, fails rather than run past its end
+class Varints
+{
+public:
+    Varints(const std::vector<uint8_t>& data) : p(&data[1]), end(&data[0] + data.size()) {}
+
+    bool next(uint32_t* v)
+    {
+        uint32_t value = 0;
+
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) {
+                return false;
+            }
+
+            uint8_t b = *p++;
+            value |= (uint32_t)(b & 0x7F) << shift;
+
+            if (!(b & 0x80)) {
+                *v = value;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool nextSigned(int32_t* v)
+    {
+        uint32_t z;
+
+        if (!next(&z)) {
+            return false;
+        }
+
+        *v = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        return true;
+    }
+
+    bool done() const
+    {
+        return p == end;
+    }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+};
+
+
+int main(int argc, char** argv)
+{
+    FILE* in = stdin;
+    static uint8_t chunk[1 << 16];
+    MspParser msp;
+    Output out;
+    int32_t fields[BB_FIELD_COUNT];
+    int32_t frame[BB_FIELD_COUNT];
+    bool haveKey = false;
+    uint32_t rows = 0;
+    uint32_t skipped = 0;
+    uint32_t malformed = 0;
+    size_t n;
+    int i;
+
+    if (argc > 2 || (argc == 2 && !strcmp(argv[1], "-h"))) {
+        fprintf(stderr, "usage: %s [capture.bin] > log.csv\n", argv[0]);
+        return 2;
+    }
+
+    if (argc == 2 && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    for (i = 0; i < BB_FIELD_COUNT; i++) {
+        out.text(i ? "," : "");
+        out.text(fieldNames[i]);
+    }
+
+    out.put('\n');
+
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        for (size_t c = 0; c < n; c++) {
+            uint32_t crcErrors = msp.crcErrors;
+            bool complete = msp.feed(chunk[c]);
+
+            // A CRC error may have been a blackbox frame, wait for the next key
+            if (msp.crcErrors != crcErrors) {
+                haveKey = false;
+            }
+
+            if (!complete || msp.cmd != MSP2_CX10_BLACKBOX || msp.payload.empty()) {
+                continue;
+            }
+
+            Varints v(msp.payload);
+            uint8_t type = msp.payload[0];
+            bool ok = true;
+
+            if (type == 'S') {
+                uint32_t stat[5];
+
+                for (i = 0; i < 5 && ok; i++) {
+                    ok = v.next(&stat[i]);
+                }
+
+                if (ok && v.done()) {
+                    fprintf(stderr, "stats: frames %u dropped %u bytes %u encode avg %u max %u cycles\n",
+                            stat[0], stat[1], stat[2], stat[3], stat[4]);
+                } else {
+                    malformed++;
+                }
+
+                continue;
+            }
+
+            if (type != 'I' && type != 'P') {
+                malformed++;
+                continue;
+            }
+
+            for (i = 0; i < BB_FIELD_COUNT && ok; i++) {
+                ok = v.nextSigned(&frame[i]);
+            }
+
+            if (!ok || !v.done()) {
+                malformed++;
+                haveKey = false;
+                continue;
+            }
+
+            if (type == 'I') {
+                memcpy(fields, frame, sizeof(fields));
+                haveKey = true;
+            } else if (haveKey) {
+                for (i = 0; i < BB_FIELD_COUNT; i++) {
+                    fields[i] += frame[i];
+                }
+            } else {
+                skipped++;
+                continue;
+            }
+
+            for (i = 0; i < BB_FIELD_COUNT; i++) {
+                if (i) {
+                    out.put(',');
+                }
+
+                // Time is the firmware's 32 bit us counter
+                out.number(i == BB_TIME ? (int64_t)(uint32_t) fields[i] : fields[i]);
+            }
+
+            out.put('\n');
+            rows++;
+        }
+    }
+
+    out.flush();
+
+    fprintf(stderr, "%u rows, %u CRC errors, %u malformed, %u deltas skipped waiting for a keyframe\n",
+            rows, msp.crcErrors, malformed, skipped);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return 0;
+}
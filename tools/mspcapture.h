@@ -0,0 +1,159 @@
+#ifndef __MSPCAPTURE_H__
+#define __MSPCAPTURE_H__
+
+// Shared by the host tools: MSP frame parsing of a raw serial capture,
+// and buffered output to stdout.
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <vector>
+
+// Output collected in a large buffer, written in few large chunks
+class Output
+{
+public:
+    Output() : buf(1 << 20), len(0) {}
+    ~Output() { flush(); }
+
+    void text(const char* s)
+    {
+        size_t n = strlen(s);
+
+        reserve(n);
+        memcpy(&buf[len], s, n);
+        len += n;
+    }
+
+    void number(int64_t v)
+    {
+        reserve(24);
+        len = std::to_chars(&buf[len], &buf[len] + 24, v).ptr - &buf[0];
+    }
+
+    void put(char c)
+    {
+        reserve(1);
+        buf[len++] = c;
+    }
+
+    void flush()
+    {
+        fwrite(&buf[0], 1, len, stdout);
+        len = 0;
+    }
+
+private:
+    void reserve(size_t n)
+    {
+        if (len + n > buf.size()) {
+            flush();
+        }
+    }
+
+    std::vector<char> buf;
+    size_t len;
+};
+
+
+// MSP v2 '$X>' frames, the state machine of mspProcessInput()
+class MspParser
+{
+public:
+    uint32_t crcErrors = 0;
+
+    // Feed one byte, true once a complete frame with a good CRC is in
+    bool feed(uint8_t c)
+    {
+        if (state >= FLAG && state <= PAYLOAD) {
+            crc = crc8(crc, c);
+        }
+
+        switch (state) {
+        case IDLE:
+            state = c == '$' ? HEADER_X : IDLE;
+            break;
+
+        // A '$' that doesn't start a frame may be followed by one that does
+        case HEADER_X:
+            state = c == 'X' ? HEADER_DIR : c == '$' ? HEADER_X : IDLE;
+            break;
+
+        case HEADER_DIR:
+            state = c == '>' ? FLAG : c == '$' ? HEADER_X : IDLE;
+            crc = 0;
+            break;
+
+        case FLAG:
+            state = CMD_LO;
+            break;
+
+        case CMD_LO:
+            cmd = c;
+            state = CMD_HI;
+            break;
+
+        case CMD_HI:
+            cmd |= c << 8;
+            state = SIZE_LO;
+            break;
+
+        case SIZE_LO:
+            size = c;
+            state = SIZE_HI;
+            break;
+
+        case SIZE_HI:
+            size |= c << 8;
+            payload.clear();
+
+            // The firmware never sends more than a byte of size
+            state = size > 255 ? IDLE : size ? PAYLOAD : CHECKSUM;
+            break;
+
+        case PAYLOAD:
+            payload.push_back(c);
+
+            if (payload.size() == size) {
+                state = CHECKSUM;
+            }
+
+            break;
+
+        case CHECKSUM:
+            state = IDLE;
+
+            if (c == crc) {
+                return true;
+            }
+
+            crcErrors++;
+            break;
+        }
+
+        return false;
+    }
+
+    uint16_t cmd = 0;
+    std::vector<uint8_t> payload;
+
+private:
+    static uint8_t crc8(uint8_t crc, uint8_t a)
+    {
+        crc ^= a;
+
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+        }
+
+        return crc;
+    }
+
+    enum { IDLE, HEADER_X, HEADER_DIR, FLAG, CMD_LO, CMD_HI, SIZE_LO, SIZE_HI,
+           PAYLOAD, CHECKSUM } state = IDLE;
+    uint16_t size = 0;
+    uint8_t crc = 0;
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*  Event trace capture to Chrome trace JSON.
+
+        traceconv [capture.bin] > trace.json
+
+    Reads a raw capture of the serial port (a file, or stdin), picks the
+    MSP2_CX10_TRACE frames out of it and writes the spans as Chrome trace
+    events, to open in Perfetto (ui.perfetto.dev) or chrome://tracing.
+    Entry layout in src/trace.h.
+
+    The 16 bit TIM3 timestamps are unwrapped into a running us time. The
+    TIM3 overflow is traced, so two entries in a row are never a wrap or
+    more apart, and each step forward modulo 65536 is the true one. Where
+    entries went missing (lost in the ring, or a frame failing the CRC)
+    that no longer holds: the step across the gap is still taken modulo
+    65536, so windows of activity may sit closer together than they were,
+    and spans left open at the gap are dropped. Both are counted on stderr.
+
+    Interrupts preempt the loop and each other last in, first out, so all
+    spans go on one track and nest the way they ran.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "trace.h"
+#include "msp.h"
+#include "mspcapture.h"
+
+static const char* eventNames[] = {
+    "loop",             // TR_LOOP
+    "TIM3",             // TR_TIM3
+    "USART",            // TR_USART
+    "serial DMA",       // TR_SERIAL_DMA
+    "PPM",              // TR_PPM
+    "radio",            // TR_RADIO
+    "SPI DMA"           // TR_SPI_DMA
+};
+
+static_assert(sizeof(eventNames) / sizeof(eventNames[0]) == TR_SPI_DMA + 1,
+              "event names out of step with trace.h");
+
+#define EVENT_COUNT (sizeof(eventNames) / sizeof(eventNames[0]))
+
+
+// A span begun and not yet ended
+struct Open {
+    uint8_t id;
+    uint8_t arg;
+    uint64_t start;
+};
+
+
+// Turns entries into JSON events, keeping the unwrapped time and the open spans
+class Converter
+{
+public:
+    Converter(Output& out) : out(out) {}
+
+    uint32_t spans = 0;
+    uint32_t gaps = 0;
+    uint32_t dropped = 0;
+    uint32_t unknown = 0;
+
+    void begin()
+    {
+        out.text("{\"traceEvents\":[\n"
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                 "\"args\":{\"name\":\"CX-10\"}}");
+    }
+
+    void end()
+    {
+        dropped += open.size();
+        out.text("\n]}\n");
+    }
+
+    // Entries before this one were lost, count lost if known (0 if not)
+    void gap(uint32_t lost)
+    {
+        if (started) {
+            gaps++;
+            dropped += open.size();
+            open.clear();
+
+            event("lost", "i", now);
+            out.text(",\"s\":\"g\"");
+
+            if (lost) {
+                out.text(",\"args\":{\"entries\":");
+                out.number(lost);
+                out.put('}');
+            }
+
+            out.put('}');
+        }
+    }
+
+    void entry(uint32_t e)
+    {
+        uint16_t ts = e >> 16;
+        uint8_t id = (e >> 8) & ~TR_END;
+        uint8_t arg = e;
+
+        now = started ? now + (uint16_t)(ts - last) : ts;
+        last = ts;
+        started = true;
+
+        if (id >= EVENT_COUNT) {
+            unknown++;
+            return;
+        }
+
+        if (!(e & (TR_END << 8))) {
+            open.push_back({id, arg, now});
+            return;
+        }
+
+        // An end without its begin, the begin was before the capture or a gap
+        if (open.empty() || open.back().id != id) {
+            dropped++;
+            return;
+        }
+
+        event(eventNames[id], "X", open.back().start);
+        out.text(",\"dur\":");
+        out.number(now - open.back().start);
+
+        if (open.back().arg) {
+            out.text(",\"args\":{\"arg\":");
+            out.number(open.back().arg);
+            out.put('}');
+        }
+
+        out.put('}');
+        open.pop_back();
+        spans++;
+    }
+
+private:
+    // Common fields, left open for the caller to finish
+    void event(const char* name, const char* ph, uint64_t ts)
+    {
+        out.text(",\n{\"name\":\"");
+        out.text(name);
+        out.text("\",\"ph\":\"");
+        out.text(ph);
+        out.text("\",\"pid\":1,\"tid\":1,\"ts\":");
+        out.number(ts);
+    }
+
+    Output& out;
+    std::vector<Open> open;
+    uint64_t now = 0;
+    uint16_t last = 0;
+    bool started = false;
+};
+
+
+int main(int argc, char** argv)
+{
+    FILE* in = stdin;
+    static uint8_t chunk[1 << 16];
+    MspParser msp;
+    Output out;
+    Converter conv(out);
+    uint32_t malformed = 0;
+    uint32_t entries = 0;
+    size_t n;
+
+    if (argc > 2 || (argc == 2 && !strcmp(argv[1], "-h"))) {
+        fprintf(stderr, "usage: %s [capture.bin] > trace.json\n", argv[0]);
+        return 2;
+    }
+
+    if (argc == 2 && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    conv.begin();
+
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        for (size_t c = 0; c < n; c++) {
+            uint32_t crcErrors = msp.crcErrors;
+            bool complete = msp.feed(chunk[c]);
+
+            // A CRC error may have been a trace frame, its entries are gone
+            if (msp.crcErrors != crcErrors) {
+                conv.gap(0);
+            }
+
+            if (!complete || msp.cmd != MSP2_CX10_TRACE) {
+                continue;
+            }
+
+            const std::vector<uint8_t>& p = msp.payload;
+
+            if (p.size() < 2 || (p.size() - 2) % 4) {
+                malformed++;
+                conv.gap(0);
+                continue;
+            }
+
+            uint16_t lost = p[0] | (p[1] << 8);
+
+            if (lost) {
+                conv.gap(lost);
+            }
+
+            for (size_t i = 2; i < p.size(); i += 4) {
+                conv.entry(p[i] | (p[i + 1] << 8) | (p[i + 2] << 16) | ((uint32_t)p[i + 3] << 24));
+                entries++;
+            }
+        }
+    }
+
+    conv.end();
+    out.flush();
+
+    fprintf(stderr, "%u entries, %u spans, %u gaps, %u spans cut by a gap or the capture ends, "
+            "%u unknown IDs, %u CRC errors, %u malformed\n",
+            entries, conv.spans, conv.gaps, conv.dropped, conv.unknown, msp.crcErrors, malformed);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return 0;
+}